@@ -4,9 +4,14 @@ import collections.abc
 import typing
 
 __all__: list[str] = [
+    "BandStatisticsCache",
     "CRITICAL",
     "CRS",
+    "CacheStats",
+    "CrsCache",
     "DEBUG",
+    "ExpressionCache",
+    "ExpressionTiming",
     "INFO",
     "Image",
     "InvalidCRSError",
@@ -15,19 +20,29 @@ __all__: list[str] = [
     "LT_UNKNOWN",
     "LT_VECTOR",
     "Layer",
+    "LayerPool",
     "LayerType",
+    "LegendCache",
+    "LegendSprite",
     "LegendSymbol",
     "LogLevel",
     "MapRequest",
+    "OverviewBuild",
     "Project",
     "QgisHeadlessError",
+    "RasterArray",
+    "RasterBlockCache",
     "RawData",
     "SF_QML",
     "SF_SLD",
     "Style",
+    "StyleCache",
     "StyleFormat",
     "StyleTypeMismatch",
     "StyleValidationError",
+    "StyleValidationResult",
+    "SvgResolver",
+    "SymbolCache",
     "WARNING",
     "deinit",
     "get_qgis_version",
@@ -39,13 +54,77 @@ __all__: list[str] = [
     "set_svg_paths",
 ]
 
+class BandStatisticsCache:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def directory() -> str: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def set_directory(path: typing.Any) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
+
 class CRS:
     @staticmethod
     def from_epsg(epsg: typing.SupportsInt) -> CRS: ...
     @staticmethod
+    def from_proj(proj: str) -> CRS: ...
+    @staticmethod
     def from_wkt(wkt: str) -> CRS: ...
     def __init__(self) -> None: ...
 
+class CacheStats:
+    @property
+    def capacity(self) -> int: ...
+    @property
+    def cost(self) -> int: ...
+    @property
+    def evictions(self) -> int: ...
+    @property
+    def hit_rate(self) -> float: ...
+    @property
+    def hits(self) -> int: ...
+    @property
+    def invalidations(self) -> int: ...
+    @property
+    def misses(self) -> int: ...
+    @property
+    def size(self) -> int: ...
+
+class CrsCache:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
+    @staticmethod
+    def transform_stats() -> CacheStats: ...
+
+class ExpressionCache:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
+    @staticmethod
+    def timings() -> list[ExpressionTiming]: ...
+
+class ExpressionTiming:
+    @property
+    def evaluate_time(self) -> float: ...
+    @property
+    def evaluations(self) -> int: ...
+    @property
+    def expression(self) -> str: ...
+    @property
+    def hits(self) -> int: ...
+    @property
+    def prepare_time(self) -> float: ...
+
 class Image:
     def size(self) -> tuple[int, int]: ...
     def to_bytes(self) -> memoryview: ...
@@ -213,15 +292,87 @@ class Layer:
     GT_POLYGON: typing.ClassVar[Layer.GeometryType]  # value = <GeometryType.GT_POLYGON: 2>
     GT_POLYGONZ: typing.ClassVar[Layer.GeometryType]  # value = <GeometryType.GT_POLYGONZ: 8>
     GT_UNKNOWN: typing.ClassVar[Layer.GeometryType]  # value = <GeometryType.GT_UNKNOWN: 12>
+    def add_features(
+        self, features: collections.abc.Iterable
+    ) -> tuple[float, float, float, float] | None: ...
+    def build_overviews(
+        self,
+        levels: collections.abc.Sequence[typing.SupportsInt],
+        resampling: str = "AVERAGE",
+        *,
+        external: bool = False,
+    ) -> None: ...
+    def build_overviews_in_background(
+        self, levels: collections.abc.Sequence[typing.SupportsInt], resampling: str = "AVERAGE"
+    ) -> OverviewBuild: ...
+    def clear_dirty_extents(self) -> None: ...
+    def delete_features(
+        self, ids: collections.abc.Sequence[typing.SupportsInt]
+    ) -> tuple[float, float, float, float] | None: ...
+    def dirty_extents(self) -> list[tuple[float, float, float, float]]: ...
+    def dirty_tiles(
+        self,
+        style: Style,
+        min_zoom: typing.SupportsInt,
+        max_zoom: typing.SupportsInt,
+        tile_size: typing.SupportsInt = 256,
+        dpi: typing.SupportsInt = 96,
+        max_label_length: typing.SupportsInt = 64,
+    ) -> list[tuple[int, int, int, int, int]]: ...
+    def overview_info(self) -> list[tuple[int, int]]: ...
+    def read_window(
+        self,
+        extent: tuple[
+            typing.SupportsFloat, typing.SupportsFloat, typing.SupportsFloat, typing.SupportsFloat
+        ],
+        size: tuple[typing.SupportsInt, typing.SupportsInt],
+        band: typing.SupportsInt = 1,
+    ) -> RasterArray: ...
+    def reload(self) -> None: ...
+    def reprojection_cache(self) -> bool: ...
+    def sample_raster(
+        self,
+        points: collections.abc.Sequence[tuple[typing.SupportsFloat, typing.SupportsFloat]],
+        band: typing.SupportsInt = 1,
+    ) -> RasterArray: ...
+    def set_reprojection_cache(self, enabled: bool) -> None: ...
+    def update_features(
+        self, features: collections.abc.Iterable
+    ) -> tuple[float, float, float, float] | None: ...
+    @staticmethod
+    def from_bytes(buffer: typing.Any, driver_hint: str = "") -> Layer: ...
     @staticmethod
     def from_data(
-        geometry_type: Layer.GeometryType, crs: CRS, attribute_types: tuple, features: tuple
+        geometry_type: Layer.GeometryType,
+        crs: CRS,
+        attribute_types: tuple,
+        features: tuple,
+        *,
+        detail_tolerances: collections.abc.Sequence[typing.SupportsFloat] = [],
     ) -> Layer: ...
     @staticmethod
     def from_gdal(uri: typing.Any) -> Layer: ...
     @staticmethod
+    def from_gdal_bytes(buffer: typing.Any, driver_hint: str = "") -> Layer: ...
+    @staticmethod
     def from_ogr(uri: typing.Any) -> Layer: ...
 
+class LayerPool:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def from_gdal(
+        uri: typing.Any, open_options: collections.abc.Sequence[tuple[str, str]] = []
+    ) -> Layer: ...
+    @staticmethod
+    def from_ogr(
+        uri: typing.Any, open_options: collections.abc.Sequence[tuple[str, str]] = []
+    ) -> Layer: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
+
 class LayerType:
     """
     Members:
@@ -254,6 +405,20 @@ class LayerType:
     @property
     def value(self) -> int: ...
 
+class LegendCache:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
+
+class LegendSprite:
+    @property
+    def image(self) -> RawData: ...
+    @property
+    def index(self) -> str: ...
+
 class LegendSymbol:
     def icon(self) -> Image: ...
     def index(self) -> int: ...
@@ -298,7 +463,18 @@ class LogLevel:
 
 class MapRequest:
     def __init__(self) -> None: ...
-    def add_layer(self, layer: Layer, style: Style, label: str = "") -> int: ...
+    def add_layer(
+        self,
+        layer: Layer,
+        style: Style,
+        label: str = "",
+        *,
+        filter: str = "",
+        filter_extent: tuple[
+            typing.SupportsFloat, typing.SupportsFloat, typing.SupportsFloat, typing.SupportsFloat
+        ]
+        | None = None,
+    ) -> int: ...
     def add_project(self, project: Project) -> None: ...
     def export_pdf(
         self,
@@ -308,6 +484,12 @@ class MapRequest:
         ],
         size: tuple[typing.SupportsInt, typing.SupportsInt],
     ) -> None: ...
+    def legend_sprite(
+        self,
+        size: tuple[typing.SupportsInt, typing.SupportsInt],
+        dpi: typing.SupportsInt | None = None,
+        count: typing.SupportsInt = 5,
+    ) -> LegendSprite: ...
     def legend_symbols(
         self,
         index: typing.SupportsInt,
@@ -329,6 +511,10 @@ class MapRequest:
     def set_crs(self, crs: CRS) -> None: ...
     def set_dpi(self, dpi: typing.SupportsInt) -> None: ...
 
+class OverviewBuild:
+    def done(self) -> bool: ...
+    def wait(self) -> None: ...
+
 class Project:
     @staticmethod
     def from_file(filename: typing.Any) -> Project: ...
@@ -337,6 +523,19 @@ class Project:
 class QgisHeadlessError(Exception):
     pass
 
+class RasterArray:
+    def tolist(self) -> list: ...
+    @property
+    def shape(self) -> tuple: ...
+
+class RasterBlockCache:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
+
 class RawData:
     def __init__(self) -> None: ...
     def size(self) -> int: ...
@@ -352,22 +551,52 @@ class Style:
     @staticmethod
     def from_file(
         file_path: typing.Any,
-        svg_resolver: collections.abc.Callable[[str], str] = None,
+        svg_resolver: collections.abc.Callable[[str], str] | None = None,
         layer_geometry_type: Layer.GeometryType = Layer.GeometryType.GT_UNKNOWN,
         layer_type: LayerType = LayerType.LT_UNKNOWN,
         format: StyleFormat = ...,
+        *,
+        svg_batch_resolver: collections.abc.Callable[[list[str]], list[str]] | None = None,
     ) -> Style: ...
     @staticmethod
     def from_string(
         string: str,
-        svg_resolver: collections.abc.Callable[[str], str] = None,
+        svg_resolver: collections.abc.Callable[[str], str] | None = None,
         layer_geometry_type: Layer.GeometryType = Layer.GeometryType.GT_UNKNOWN,
         layer_type: LayerType = LayerType.LT_UNKNOWN,
         format: StyleFormat = ...,
+        *,
+        svg_batch_resolver: collections.abc.Callable[[list[str]], list[str]] | None = None,
     ) -> Style: ...
+    @staticmethod
+    def validate_many(styles: collections.abc.Iterable) -> list[StyleValidationResult]: ...
+    def max_bleed(
+        self, dpi: typing.SupportsInt = 96, max_label_length: typing.SupportsInt = 64
+    ) -> float: ...
+    def memory_usage(self) -> int: ...
+    def needs_source_features(self) -> bool: ...
     def scale_range(self) -> tuple: ...
     def to_string(self, format: StyleFormat = ...) -> str: ...
     def used_attributes(self) -> set[str] | None: ...
+    def with_memoized_expressions(self) -> Style: ...
+
+class StyleCache:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def from_string(
+        string: str,
+        svg_resolver: collections.abc.Callable[[str], str] | None = None,
+        layer_geometry_type: Layer.GeometryType = Layer.GeometryType.GT_UNKNOWN,
+        layer_type: LayerType = LayerType.LT_UNKNOWN,
+        format: StyleFormat = ...,
+        *,
+        svg_batch_resolver: collections.abc.Callable[[list[str]], list[str]] | None = None,
+    ) -> Style: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
 
 class StyleFormat:
     """
@@ -404,6 +633,32 @@ class StyleTypeMismatch(StyleValidationError):
 class StyleValidationError(QgisHeadlessError):
     pass
 
+class StyleValidationResult:
+    @property
+    def error(self) -> str | None: ...
+    @property
+    def scale_range(self) -> tuple: ...
+    @property
+    def used_attributes(self) -> set[str] | None: ...
+    @property
+    def valid(self) -> bool: ...
+
+class SvgResolver:
+    @staticmethod
+    def clear() -> None: ...
+    @staticmethod
+    def set_capacity(capacity: typing.SupportsInt) -> None: ...
+    @staticmethod
+    def stats() -> CacheStats: ...
+
+class SymbolCache:
+    @staticmethod
+    def preload(
+        style: Style,
+        dpi: typing.SupportsInt = 96,
+        sizes: collections.abc.Sequence[typing.SupportsInt] = [],
+    ) -> None: ...
+
 def deinit() -> None:
     """
     Library deinitialization
@@ -1,3 +1,7 @@
+import os
+from shutil import copyfile
+from time import perf_counter
+
 import pytest
 
 from qgis_headless import CRS, LT_VECTOR, Layer, MapRequest, Style
@@ -72,3 +76,95 @@ def test_bloat(payload, benchmark):
         mreq.render_image(extent, (512, 512))
 
     benchmark(_render_image)
+
+
+@pytest.mark.benchmark(group="style")
+@pytest.mark.parametrize(
+    "style_fn, resolver",
+    (
+        pytest.param("contour/simple.qml", False, id="simple"),
+        pytest.param("contour/rbl.qml", False, id="rule-based"),
+        pytest.param("attributes/osm-highway.qml", False, id="labeling"),
+        pytest.param("contour/simple.qml", True, id="simple-resolver"),
+    ),
+)
+def test_style(style_fn, resolver, benchmark, shared_datadir):
+    qml = (shared_datadir / style_fn).read_text()
+    params = dict(svg_resolver=lambda path: path) if resolver else dict()
+
+    def _from_string():
+        style = Style.from_string(qml, **params)
+        style.used_attributes()
+        style.scale_range()
+
+    benchmark(_from_string)
+
+    # Used attributes and scale range are read during construction, without importing again
+    start = perf_counter()
+    style = Style.from_string(qml, **params)
+    construction = perf_counter() - start
+
+    start = perf_counter()
+    for _ in range(10):
+        style.used_attributes()
+        style.scale_range()
+    assert (perf_counter() - start) / 10 < construction / 2
+
+
+def _rss():
+    with open("/proc/self/statm") as fd:
+        return int(fd.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+
+
+@pytest.mark.benchmark(group="soak")
+@pytest.mark.parametrize("styles", (1, 4, 64))
+def test_soak(styles, benchmark, shared_datadir):
+    extent = (9757454.0, 6450871.0, 9775498.0, 6465163.0)
+
+    crs = CRS.from_epsg(3857)
+    layer = Layer.from_ogr(str(shared_datadir / "contour/data.geojson"))
+    qml = (shared_datadir / "contour/simple.qml").read_text()
+    style_list = [
+        Style.from_string(qml.replace('"0,0,0,255"', f'"{i},0,0,255"')) for i in range(styles)
+    ]
+
+    def _render_images():
+        for style in style_list:
+            mreq = MapRequest()
+            mreq.set_dpi(96)
+            mreq.set_crs(crs)
+            mreq.add_layer(layer, style)
+            mreq.render_image(extent, (256, 256))
+
+    # Warm up, so that growth is measured against steady state
+    _render_images()
+    rss = _rss()
+
+    benchmark.pedantic(_render_images, rounds=50)
+    rss_growth = _rss() - rss
+    benchmark.extra_info["rss_growth"] = rss_growth
+
+    # Unbounded style manager would keep a compiled style per render, thousands of them
+    assert rss_growth < 16 * 2**20
+
+
+@pytest.mark.benchmark(group="overviews")
+@pytest.mark.parametrize("overviews", (False, True), ids=("without", "with"))
+def test_overviews(overviews, benchmark, shared_datadir, tmp_path):
+    source = tmp_path / "dem.tif"
+    copyfile(shared_datadir / "raster/sochi-aster-dem.tif", source)
+
+    layer = Layer.from_gdal(source)
+    if overviews:
+        layer.build_overviews([2, 4, 8, 16], external=True)
+
+    mreq = MapRequest()
+    mreq.set_dpi(96)
+    mreq.set_crs(CRS.from_epsg(4326))
+    mreq.add_layer(layer, Style.from_defaults())
+
+    def _render_image():
+        # Low zoom tile, which covers the whole raster
+        mreq.render_image((39.0, 42.0, 42.0, 45.0), (256, 256))
+
+    benchmark(_render_image)
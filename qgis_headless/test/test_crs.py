@@ -1,16 +1,20 @@
 import pytest
 
-from qgis_headless import CRS, InvalidCRSError
+from qgis_headless import CRS, CrsCache, InvalidCRSError
 
 
 def test_crs_from_epsg_valid():
     CRS.from_epsg(3857)
     CRS.from_epsg(4326)
+    CRS.from_epsg(32637)
+    CRS.from_epsg(2154)
 
 
 def test_crs_from_epsg_invalid():
     with pytest.raises(InvalidCRSError):
         CRS.from_epsg(-1)
+    with pytest.raises(InvalidCRSError):
+        CRS.from_epsg(999999)
 
 
 def test_crs_from_wkt_valid():
@@ -28,3 +32,24 @@ def test_crs_from_wkt_valid():
 def test_crs_from_wkt_invalid():
     with pytest.raises(InvalidCRSError):
         CRS.from_wkt('GEOGCRS["WGS 84",')
+
+
+def test_crs_from_proj():
+    CRS.from_proj("+proj=utm +zone=37 +datum=WGS84 +units=m +no_defs")
+    with pytest.raises(InvalidCRSError):
+        CRS.from_proj("+proj=unknown")
+
+
+def test_crs_cache():
+    CrsCache.clear()
+
+    CRS.from_epsg(32637)
+    CRS.from_epsg(32637)
+    CRS.from_proj("+proj=utm +zone=37 +datum=WGS84 +units=m +no_defs")
+    CRS.from_proj("+proj=utm  +zone=37 +datum=WGS84 +units=m +no_defs")
+
+    stats = CrsCache.stats()
+    assert (stats.hits, stats.misses) == (2, 2)
+
+    CrsCache.clear()
+    assert CrsCache.stats().size == 0
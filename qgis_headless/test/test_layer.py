@@ -1,3 +1,7 @@
+import math
+import os
+from shutil import copyfile
+from struct import pack
 from subprocess import CalledProcessError, check_call
 from sys import executable
 from textwrap import dedent
@@ -5,7 +9,15 @@ from xml.sax.saxutils import quoteattr
 
 import pytest
 
-from qgis_headless import CRS, InvalidLayerSource, Layer
+from qgis_headless import (
+    CRS,
+    BandStatisticsCache,
+    InvalidLayerSource,
+    Layer,
+    LayerPool,
+    QgisHeadlessError,
+    Style,
+)
 from qgis_headless.util import (
     EXTENT_ONE,
     WKB_LINESTRING,
@@ -64,6 +76,28 @@ def test_from_data_linestring(shared_datadir, reset_svg_paths):
     )
 
 
+@pytest.mark.parametrize("size", (256, 16))
+def test_from_data_detail_tolerances(size, shared_datadir, reset_svg_paths):
+    style = (shared_datadir / "contour/red.qml").read_text()
+    crs = CRS.from_epsg(3857)
+
+    points = [(-0.4 + 0.008 * i, 0.01 * (i % 2)) for i in range(101)]
+    wkb = pack("<BII", 1, 2, len(points)) + b"".join(pack("<dd", x, y) for x, y in points)
+
+    layer = Layer.from_data(
+        Layer.GT_LINESTRING,
+        crs,
+        (),
+        ((1, wkb, ()),),
+        detail_tolerances=(0.1, 0.01),
+    )
+
+    img = render_vector(layer, style, EXTENT_ONE, size)
+
+    stat = image_stat(img)
+    assert stat.red.max == 255, "Red line missing"
+
+
 @pytest.mark.parametrize(
     "ftype, fvalue, cond",
     (
@@ -159,3 +193,236 @@ def test_wrong_source(shared_datadir):
         Layer.from_ogr(shared_datadir / "raster" / "rounds.tif")
     with pytest.raises(InvalidLayerSource):
         Layer.from_gdal(shared_datadir / "poly.geojson")
+
+
+def test_from_bytes(shared_datadir, reset_svg_paths):
+    data = (shared_datadir / "poly.geojson").read_bytes()
+    style = (shared_datadir / "25d" / "poly_25d.qml").read_text()
+
+    layer = Layer.from_bytes(memoryview(data), "GeoJSON")
+    img = render_vector(layer, style, (-10, -10, 10, 10))
+
+    stat = image_stat(img)
+    assert stat.blue.max == 255, "Roof is missing"
+
+    Layer.from_gdal_bytes((shared_datadir / "raster" / "rounds.tif").read_bytes(), "GTiff")
+
+    with pytest.raises(InvalidLayerSource):
+        Layer.from_bytes(data, "NoSuchDriver")
+
+
+def test_layer_pool(shared_datadir, tmp_path):
+    source = tmp_path / "poly.geojson"
+    copyfile(shared_datadir / "poly.geojson", source)
+
+    LayerPool.clear()
+
+    LayerPool.from_ogr(source)
+    LayerPool.from_ogr(source)
+
+    stats = LayerPool.stats()
+    assert (stats.hits, stats.misses, stats.size) == (1, 1, 1)
+    assert stats.hit_rate == 0.5
+
+    st = source.stat()
+    os.utime(source, ns=(st.st_atime_ns, st.st_mtime_ns + 10**9))
+    LayerPool.from_ogr(source)
+    stats = LayerPool.stats()
+    assert (stats.hits, stats.misses, stats.invalidations) == (1, 2, 1)
+
+    LayerPool.set_capacity(1)
+    LayerPool.from_gdal(shared_datadir / "raster" / "rounds.tif")
+    stats = LayerPool.stats()
+    assert (stats.evictions, stats.size) == (1, 1)
+
+    LayerPool.clear()
+    LayerPool.set_capacity(64)
+
+
+def test_edit_features(shared_datadir, reset_svg_paths):
+    style = (shared_datadir / "zero/red-circle.qml").read_text()
+
+    layer = Layer.from_data(
+        Layer.GT_POINT,
+        CRS.from_epsg(3857),
+        (("f_integer", Layer.FT_INTEGER),),
+        ((1, WKB_POINT_00, (1,)), (2, WKB_POINT_11, (2,))),
+    )
+
+    def red_max():
+        return image_stat(render_vector(layer, style, EXTENT_ONE, 64)).red.max
+
+    assert red_max() == 255
+
+    assert layer.delete_features((1,)) == (0, 0, 0, 0)
+    assert red_max() == 0
+
+    assert layer.add_features(((3, WKB_POINT_00, (3,)),)) == (0, 0, 0, 0)
+    assert red_max() == 255
+
+    assert layer.update_features(((3, WKB_POINT_11, (3,)),)) == (0, 0, 1, 1)
+    assert red_max() == 0
+
+    assert layer.delete_features(()) is None
+
+    with pytest.raises(QgisHeadlessError):
+        layer.delete_features((1,))
+    with pytest.raises(QgisHeadlessError):
+        layer.add_features(((2, WKB_POINT_00, (2,)),))
+    with pytest.raises(QgisHeadlessError):
+        layer.add_features(((5, WKB_POINT_00, (5,)), (5, WKB_POINT_11, (5,))))
+    with pytest.raises(QgisHeadlessError):
+        Layer.from_ogr(shared_datadir / "poly.geojson").delete_features((1,))
+
+
+def test_dirty_tiles(shared_datadir, reset_svg_paths):
+    style = Style.from_string((shared_datadir / "zero/red-circle.qml").read_text())
+    assert style.max_bleed(96) > 0
+
+    layer = Layer.from_data(
+        Layer.GT_POINT,
+        CRS.from_epsg(3857),
+        (("f_integer", Layer.FT_INTEGER),),
+        ((1, WKB_POINT_00, (1,)),),
+    )
+    assert layer.dirty_tiles(style, 0, 2) == []
+
+    layer.update_features(((1, WKB_POINT_11, (1,)),))
+    assert layer.dirty_extents() == [(0, 0, 1, 1)]
+
+    # Point near the origin touches four central tiles, starting from zoom 1
+    assert layer.dirty_tiles(style, 0, 2) == [
+        (0, 0, 0, 0, 0),
+        (1, 0, 0, 1, 1),
+        (2, 1, 1, 2, 2),
+    ]
+
+    with pytest.raises(QgisHeadlessError):
+        layer.dirty_tiles(style, -1, 2)
+    with pytest.raises(QgisHeadlessError):
+        layer.dirty_tiles(style, 0, 31)
+
+    layer.clear_dirty_extents()
+    assert layer.dirty_extents() == []
+
+    # Labels are assumed to be as wide as the longest text
+    labeled = Style.from_file(shared_datadir / "attributes/rule-based-labeling.qml")
+    assert labeled.max_bleed(96, max_label_length=100) > labeled.max_bleed(96, max_label_length=10)
+
+
+def test_reprojection_cache(shared_datadir, reset_svg_paths):
+    style = (shared_datadir / "zero/red-circle.qml").read_text()
+
+    layer = Layer.from_data(
+        Layer.GT_POINT,
+        CRS.from_epsg(4326),
+        (("f_integer", Layer.FT_INTEGER),),
+        ((1, WKB_POINT_00, (1,)),),
+    )
+    assert not layer.reprojection_cache()
+    layer.set_reprojection_cache(True)
+    assert layer.reprojection_cache()
+
+    def red_max():
+        return image_stat(render_vector(layer, style, EXTENT_ONE, 64)).red.max
+
+    assert red_max() == 255
+    assert red_max() == 255
+
+    # Point at 1 degree from the origin is far outside of the EPSG:3857 extent
+    layer.update_features(((1, WKB_POINT_11, (1,)),))
+    assert red_max() == 0
+
+    layer.set_reprojection_cache(False)
+    assert red_max() == 0
+
+
+def test_reprojection_cache_source_features(shared_datadir, reset_svg_paths):
+    # Marker is hidden if $x is evaluated in EPSG:3857, where the point is 0.11 m from the origin
+    qml = (shared_datadir / "zero/red-circle.qml").read_text()
+    qml = qml.replace(
+        '<Option name="properties"/>',
+        '<Option type="Map" name="properties"><Option type="Map" name="size">'
+        '<Option type="bool" value="true" name="active"/>'
+        f'<Option type="QString" value={quoteattr("if($x > 0.01, 0, 4)")} name="expression"/>'
+        '<Option type="int" value="3" name="type"/>'
+        "</Option></Option>",
+    )
+    style = Style.from_string(qml)
+    assert style.needs_source_features()
+    assert not Style.from_file(shared_datadir / "zero/red-circle.qml").needs_source_features()
+
+    layer = Layer.from_data(
+        Layer.GT_POINT,
+        CRS.from_epsg(4326),
+        (("f_integer", Layer.FT_INTEGER),),
+        ((1, pack("<bIdd", 1, 1, 1e-6, 0), (1,)),),
+    )
+
+    def red_max():
+        return image_stat(render_vector(layer, style, EXTENT_ONE, 64)).red.max
+
+    assert red_max() == 255
+    layer.set_reprojection_cache(True)
+    assert red_max() == 255
+    assert red_max() == 255
+
+
+def test_build_overviews(shared_datadir, tmp_path):
+    source = tmp_path / "dem.tif"
+    copyfile(shared_datadir / "raster/sochi-aster-dem.tif", source)
+
+    layer = Layer.from_gdal(source)
+    assert layer.overview_info() == []
+
+    layer.build_overviews([2, 4], "NEAREST", external=True)
+    assert (tmp_path / "dem.tif.ovr").exists()
+    info = layer.overview_info()
+    assert len(info) == 2 and info[0][0] > info[1][0]
+
+    layer.build_overviews([])
+    assert layer.overview_info() == []
+
+    build = layer.build_overviews_in_background([2, 4, 8])
+    build.wait()
+    assert build.done()
+    assert len(layer.overview_info()) == 3
+
+    # Statistics of the reloaded source are computed again
+    BandStatisticsCache.clear()
+    Layer.from_gdal(source)
+    layer.reload()
+    Layer.from_gdal(source)
+    assert (BandStatisticsCache.stats().hits, BandStatisticsCache.stats().misses) == (0, 2)
+
+    with pytest.raises(QgisHeadlessError):
+        layer.build_overviews([1])
+    with pytest.raises(QgisHeadlessError):
+        Layer.from_ogr(shared_datadir / "poly.geojson").overview_info()
+
+
+def test_sample_raster(shared_datadir):
+    layer = Layer.from_gdal(shared_datadir / "raster/sochi-aster-dem.tif")
+
+    window = layer.read_window((40.0, 43.0, 41.0, 44.0), (400, 400))
+    assert window.shape == (400, 400)
+    rows = window.tolist()
+    assert not any(math.isnan(v) for row in rows for v in row)
+
+    # Centers of pixels: top left, bottom right and one outside
+    values = layer.sample_raster([(40.00125, 43.99875), (40.99875, 43.00125), (39.5, 43.5)])
+    assert values.shape == (3,)
+    values = values.tolist()
+    assert values[:2] == [rows[0][0], rows[399][399]]
+    assert math.isnan(values[2])
+
+    # Window extending beyond the raster is padded with NaN
+    rows = layer.read_window((40.5, 43.5, 41.5, 44.5), (4, 4)).tolist()
+    assert math.isnan(rows[0][3]) and not math.isnan(rows[3][0])
+
+    with pytest.raises(QgisHeadlessError):
+        layer.sample_raster([(40.5, 43.5)], band=2)
+    with pytest.raises(QgisHeadlessError):
+        layer.read_window((40.0, 43.0, 41.0, 44.0), (0, 10))
+    with pytest.raises(QgisHeadlessError):
+        Layer.from_ogr(shared_datadir / "poly.geojson").sample_raster([(0, 0)])
@@ -1,5 +1,8 @@
+import json
+from io import BytesIO
 from typing import Any, Dict
 
+import PIL.Image
 import pytest
 from packaging import version
 
@@ -7,6 +10,7 @@ from qgis_headless import (
     CRS,
     LT_VECTOR,
     Layer,
+    LegendCache,
     MapRequest,
     QgisHeadlessError,
     Style,
@@ -65,6 +69,27 @@ def test_legend(save_img, shared_datadir, reset_svg_paths):
     )
 
 
+def test_legend_reuse(shared_datadir):
+    layer = Layer.from_ogr(shared_datadir / "categories/rgb.geojson")
+    red = Style.from_defaults(layer_type=LT_VECTOR, layer_geometry_type=Layer.GT_POINT, color=RED)
+
+    req = MapRequest()
+    req.set_dpi(96)
+    req.add_layer(layer, red, label="Red")
+
+    first = to_pil(req.render_legend())
+    assert first.tobytes() == to_pil(req.render_legend()).tobytes()
+    assert to_pil(req.render_legend((200, 100))).size == (200, 100)
+
+    # Applying another style to the shared layer invalidates the legend
+    other = MapRequest()
+    other.add_layer(layer, Style.from_file(shared_datadir / "categories/rgb.qml"))
+    assert to_pil(req.render_legend()).size[1] > first.size[1]
+
+    req.add_layer(Layer.from_ogr(shared_datadir / "categories/rgb.geojson"), red, label="Red")
+    assert to_pil(req.render_legend()).size[1] > first.size[1]
+
+
 LEGEND_DEFAULT_SIZES = [20, 40]
 
 legend_symbols_params = []
@@ -283,6 +308,29 @@ def test_legend_symbols_render(style_file, layer_file, extent, cases, shared_dat
                     assert getattr(stat, band).max == band_max, f"{band} color mismatch"
 
 
+def test_render_symbols_reset(shared_datadir):
+    style = Style.from_file(shared_datadir / "categories/rgb.qml")
+    layer = Layer.from_ogr(shared_datadir / "categories/rgb.geojson")
+    extent = (-4400, -14000, 4400, 14000)
+
+    def render(symbols=None):
+        req = MapRequest()
+        req.set_dpi(96)
+        req.add_layer(layer, style)
+        req.set_crs(CRS.from_epsg(3857))
+        params: Dict[str, Any] = dict(extent=extent, size=(256, 256))
+        if symbols is not None:
+            params["symbols"] = ((0, symbols),)
+        stat = image_stat(to_pil(req.render_image(**params)))
+        return (stat.red.max, stat.green.max, stat.blue.max)
+
+    # Symbols hidden by a request must be visible again, when the same style is added again
+    assert render((0,)) == (255, 0, 0)
+    assert render() == (255, 0, 255)
+    assert render((1,)) == (0, 255, 0)
+    assert render() == (255, 0, 255)
+
+
 def test_legend_svg_path(save_img, shared_datadir, reset_svg_paths):
     data_path = shared_datadir / "zero/data.geojson"
     style_path = shared_datadir / "zero/marker.qml"
@@ -291,3 +339,97 @@ def test_legend_svg_path(save_img, shared_datadir, reset_svg_paths):
 
     stat = image_stat(save_img(render_legend(data_path, style_path, "Marker")))
     assert stat.blue.max == 255, "Blue marker is missing"
+
+
+def test_legend_symbols_order():
+    count = 100
+    categories = "".join(
+        f'<category render="true" type="string" value="c{i}" label="C{i}" symbol="{i}"/>'
+        for i in range(count)
+    )
+    symbols = "".join(
+        f'<symbol type="marker" name="{i}" alpha="1">'
+        '<layer class="SimpleMarker" enabled="1" pass="0"><Option type="Map">'
+        f'<Option type="QString" value="{i},0,{255 - i},255" name="color"/>'
+        '<Option type="QString" value="square" name="name"/>'
+        '<Option type="QString" value="no" name="outline_style"/>'
+        '<Option type="QString" value="10" name="size"/>'
+        "</Option></layer></symbol>"
+        for i in range(count)
+    )
+    qml = (
+        '<qgis styleCategories="Symbology">'
+        '<renderer-v2 type="categorizedSymbol" attr="name">'
+        f"<categories>{categories}</categories><symbols>{symbols}</symbols>"
+        "</renderer-v2></qgis>"
+    )
+
+    req = MapRequest()
+    req.set_dpi(96)
+    layer = Layer.from_data(Layer.GT_POINT, CRS.from_epsg(3857), (), ())
+    req.add_layer(layer, Style.from_string(qml))
+
+    # Symbols are drawn by several threads, but returned in the order of categories
+    symbols = req.legend_symbols(0, (16, 16))
+    assert [s.title() for s in symbols] == [f"C{i}" for i in range(count)]
+    for i, symbol in enumerate(symbols):
+        assert to_pil(symbol.icon()).getpixel((8, 8)) == (i, 0, 255 - i, 255)
+
+
+def test_legend_cache(shared_datadir):
+    req = MapRequest()
+    req.set_dpi(96)
+    req.set_crs(CRS.from_epsg(3857))
+    req.add_layer(
+        Layer.from_ogr(shared_datadir / "categories/rgb.geojson"),
+        Style.from_file(shared_datadir / "categories/rgb.qml"),
+    )
+
+    LegendCache.clear()
+    symbols = req.legend_symbols(0, (20, 20))
+    cached = req.legend_symbols(0, (20, 20))
+    assert (LegendCache.stats().hits, LegendCache.stats().misses) == (1, 1)
+    assert [s.icon().to_bytes() for s in symbols] == [s.icon().to_bytes() for s in cached]
+
+    req.legend_symbols(0, (20, 20), count=3)
+    req.legend_symbols(0, (40, 40))
+    assert LegendCache.stats().misses == 3
+
+    # Check states of symbols are a part of the key
+    req.render_image((-4400, -14000, 4400, 14000), (64, 64), symbols=((0, (0,)),))
+    states = [s.render() for s in req.legend_symbols(0, (20, 20))]
+    assert states == [True] + [False] * (len(symbols) - 1)
+
+    LegendCache.clear()
+    assert LegendCache.stats().size == 0
+
+
+def test_legend_sprite(shared_datadir):
+    size = (20, 16)
+    req = MapRequest()
+    req.set_dpi(96)
+    req.add_layer(
+        Layer.from_ogr(shared_datadir / "contour/data.geojson"),
+        Style.from_file(shared_datadir / "contour/rgb.qml"),
+    )
+    req.add_layer(
+        Layer.from_data(Layer.GT_POINT, CRS.from_epsg(3857), (), ()),
+        Style.from_defaults(layer_type=LT_VECTOR, layer_geometry_type=Layer.GT_POINT, color=RED),
+    )
+
+    sprite = req.legend_sprite(size)
+    index = json.loads(sprite.index)
+    symbols = req.legend_symbols(0, size)
+    assert [s["layer"] for s in index] == [0] * len(symbols) + [1]
+    assert [s["title"] for s in index[: len(symbols)]] == [s.title() for s in symbols]
+
+    img = PIL.Image.open(BytesIO(sprite.image.to_bytes())).convert("RGBA")
+    for item in index:
+        assert (item["width"], item["height"]) == size
+        box = (item["x"], item["y"], item["x"] + item["width"], item["y"] + item["height"])
+        assert image_stat(img.crop(box)).alpha.max == 255, "Symbol is missing"
+
+    assert image_stat(img.crop(box)).red.max == 255, "Red marker is missing"
+
+    with pytest.raises(QgisHeadlessError):
+        req.legend_sprite((0, 0))
@@ -1,7 +1,10 @@
+import json
 import os
 import os.path
 from binascii import a2b_hex
+from html import escape
 from itertools import product
+from shutil import copyfile
 from tempfile import NamedTemporaryFile
 
 import pytest
@@ -10,11 +13,18 @@ from pytest import approx
 
 from qgis_headless import (
     CRS,
+    BandStatisticsCache,
+    ExpressionCache,
     Layer,
     MapRequest,
+    QgisHeadlessError,
+    RasterBlockCache,
     Style,
+    StyleCache,
     StyleFormat,
     StyleTypeMismatch,
+    SvgResolver,
+    SymbolCache,
     get_qgis_version,
     set_svg_paths,
 )
@@ -22,6 +32,7 @@ from qgis_headless.util import (
     EXTENT_ONE,
     RED,
     WKB_POINT_00,
+    WKB_POINT_11,
     image_stat,
     render_raster,
     render_vector,
@@ -229,6 +240,109 @@ def test_svg_resolver(shared_datadir, reset_svg_paths):
     assert image_stat(img).blue.max == 255, "Blue marker is missing"
 
 
+def test_svg_batch_resolver(shared_datadir, reset_svg_paths):
+    data = shared_datadir / "zero/data.geojson"
+    qml = (shared_datadir / "zero/marker.qml").read_text()
+    marker = str((shared_datadir / "marker-blue" / "marker.svg").resolve())
+
+    calls = list()
+
+    def _resolver(sources):
+        calls.append(sources)
+        return [marker for _ in sources]
+
+    style = Style.from_string(qml, svg_batch_resolver=_resolver)
+    assert calls == [["marker.svg"]], "Batch resolver isn't called once"
+
+    img = render_vector(data, style, EXTENT_ONE, 256)
+    assert image_stat(img).blue.max == 255, "Blue marker is missing"
+
+    with pytest.raises(ValueError):
+        Style.from_string(qml, svg_resolver=lambda p: p, svg_batch_resolver=_resolver)
+
+    with pytest.raises(QgisHeadlessError):
+        Style.from_string(qml, svg_batch_resolver=lambda sources: [])
+
+
+def test_svg_resolver_memoize(shared_datadir, reset_svg_paths):
+    qml = (shared_datadir / "zero/marker.qml").read_text()
+    svg_fill = (shared_datadir / "zero/svg-fill.qml").read_text()
+
+    resolved = list()
+
+    def _resolver(source):
+        resolved.append(source)
+        return source
+
+    StyleCache.clear()
+    SvgResolver.clear()
+
+    StyleCache.from_string(qml, _resolver)
+    StyleCache.from_string(svg_fill, _resolver)
+    assert resolved == ["marker.svg"], "Resolved path isn't memoized"
+
+    stats = SvgResolver.stats()
+    assert (stats.hits, stats.misses, stats.size) == (1, 1, 1)
+
+    SvgResolver.clear()
+    StyleCache.clear()
+
+
+def test_preload_symbols(shared_datadir, reset_svg_paths, tmp_path):
+    qml = (shared_datadir / "zero/marker.qml").read_text()
+    marker = tmp_path / "marker.svg"
+    copyfile(shared_datadir / "marker-blue" / "marker.svg", marker)
+    style = Style.from_string(qml, svg_resolver=lambda _: str(marker))
+
+    # Unusual DPIs, so that the marker isn't cached by other tests
+    SymbolCache.preload(style, dpi=113, sizes=[16, 32])
+
+    # Marker is rendered from the SVG cache only, if it was rasterized by preload()
+    marker.unlink()
+    img = render_vector(shared_datadir / "zero/data.geojson", style, EXTENT_ONE, 256, dpi=113)
+    assert image_stat(img).blue.max == 255, "Blue marker is missing"
+
+    img = render_vector(shared_datadir / "zero/data.geojson", style, EXTENT_ONE, 256, dpi=127)
+    assert image_stat(img).blue.max < 255, "Marker isn't preloaded at this DPI"
+
+
+def test_memoized_expressions(shared_datadir):
+    expression = '"f_integer" * 4'
+    qml = (shared_datadir / "zero/red-circle.qml").read_text()
+    qml = qml.replace(
+        '<Option name="properties"/>',
+        '<Option type="Map" name="properties"><Option type="Map" name="size">'
+        '<Option type="bool" value="true" name="active"/>'
+        f'<Option type="QString" value="{escape(expression, quote=True)}" name="expression"/>'
+        '<Option type="int" value="3" name="type"/>'
+        "</Option></Option>",
+    )
+    style = Style.from_string(qml).with_memoized_expressions()
+    assert "headless_memoize" in style.to_string()
+
+    def layer():
+        # Features differ by id and unreferenced attribute only
+        return Layer.from_data(
+            Layer.GT_POINT,
+            CRS.from_epsg(3857),
+            (("f_integer", Layer.FT_INTEGER), ("f_string", Layer.FT_STRING)),
+            ((1, WKB_POINT_00, (4, "foo")), (2, WKB_POINT_11, (4, "bar"))),
+        )
+
+    ExpressionCache.clear()
+    img = render_vector(layer(), style, EXTENT_ONE, 256)
+    assert image_stat(img).red.max == 255, "Red marker is missing"
+
+    timing = {t.expression: t for t in ExpressionCache.timings()}[expression]
+    assert timing.hits > 0, "Result isn't shared between features with equal attributes"
+    misses = ExpressionCache.stats().misses
+
+    # Another layer with the same fields reuses results
+    img = render_vector(layer(), style, EXTENT_ONE, 256)
+    assert image_stat(img).red.max == 255, "Red marker is missing"
+    assert ExpressionCache.stats().misses == misses
+
+
 @pytest.mark.skipif(
     QGIS_VERSION < version.parse("3.14"),
     reason="Fetching marker by URL may fail in QGIS < 3.14",
@@ -368,6 +482,17 @@ def test_attribute_color(save_img, shared_datadir):
     assert stat.blue.max == 0, "Blue band is not expected"
 
 
+def test_style_without_geometry_type(shared_datadir):
+    # Style has no layerGeometryType element, so it must be applicable to polygons
+    style = Style.from_file(shared_datadir / "landuse" / "landuse.qml")
+    layer = Layer.from_ogr(shared_datadir / "landuse" / "landuse.geojson")
+    extent = (4189314.0, 7505071.0, 4190452.0, 7506101.0)
+
+    for applied in (style, style, style.with_memoized_expressions()):
+        stat = image_stat(render_vector(layer, applied, extent))
+        assert (stat.red.max, stat.green.max, stat.blue.max) == (255, 255, 0)
+
+
 def test_style_25d(save_img, shared_datadir):
     data = shared_datadir / "poly.geojson"
     layer = Layer.from_ogr(data)
@@ -480,6 +605,48 @@ def test_raster(style_file, shared_datadir):
     assert (stat.red.max, stat.green.max, stat.blue.max) == (0, 0, 0), "Black colour missing"
 
 
+def test_raster_block_cache(shared_datadir, tmp_path):
+    source = tmp_path / "rounds.tif"
+    copyfile(shared_datadir / "raster" / "rounds.tif", source)
+    layer = Layer.from_gdal(source)
+    style = Style.from_file(shared_datadir / "raster" / "rounds_334.qml")
+    crs = CRS.from_epsg(4326)
+
+    # Neighbouring tiles of the red quadrant in EPSG:4326
+    tiles = [(x, y, x + 8, y + 4) for x in (2.0, 10.0) for y in (47.5, 51.5)]
+
+    # The cache is disabled by default
+    RasterBlockCache.clear()
+    render_raster(layer, style, tiles[0], crs=crs)
+    assert RasterBlockCache.stats().size == 0
+
+    RasterBlockCache.set_capacity(64 * 1024 * 1024)
+    for tile in tiles:
+        stat = image_stat(render_raster(layer, style, tile, crs=crs))
+        assert (stat.red.max, stat.green.max, stat.blue.max) == (255, 0, 0), "Red colour missing"
+
+    stats = RasterBlockCache.stats()
+    assert stats.misses > 0 and stats.cost > 0
+    assert stats.size < stats.misses + stats.hits, "Tiles don't share blocks"
+
+    for tile in tiles:
+        render_raster(layer, style, tile, crs=crs)
+    assert RasterBlockCache.stats().misses == stats.misses
+
+    # Blocks of the modified file aren't reused
+    mtime = source.stat().st_mtime
+    os.utime(source, (mtime + 10, mtime + 10))
+    render_raster(layer, style, tiles[0], crs=crs)
+    assert RasterBlockCache.stats().misses > stats.misses
+
+    RasterBlockCache.set_capacity(0)
+    stat = image_stat(render_raster(layer, style, tiles[0], crs=crs))
+    assert (stat.red.max, stat.green.max, stat.blue.max) == (255, 0, 0), "Red colour missing"
+    assert RasterBlockCache.stats().size == 0
+
+    RasterBlockCache.clear()
+
+
 def test_raster_layer_vector_style(shared_datadir):
     layer = Layer.from_gdal(shared_datadir / "raster" / "rounds.tif")
     style = Style.from_file(shared_datadir / "point-style.qml")
@@ -689,3 +856,106 @@ def test_rendering_order(layer_name, style_name, extent, save_img, shared_datadi
         render_vector(layer, inverted_style, extent, crs=crs), suffix="-inverted"
     )
     assert not left_overlaps_right(inverted_image)
+
+
+@pytest.mark.parametrize(
+    "flt, flt_extent, present",
+    (
+        pytest.param("", None, True, id="none"),
+        pytest.param("f_integer = 1", None, True, id="expression-match"),
+        pytest.param("f_integer = 2", None, False, id="expression-mismatch"),
+        pytest.param("", (-0.1, -0.1, 0.1, 0.1), True, id="extent-match"),
+        pytest.param("", (0.9, 0.9, 1.1, 1.1), False, id="extent-mismatch"),
+    ),
+)
+def test_layer_filter(flt, flt_extent, present, shared_datadir, reset_svg_paths):
+    style = Style.from_string((shared_datadir / "zero/red-circle.qml").read_text())
+    layer = Layer.from_data(
+        Layer.GT_POINT,
+        CRS.from_epsg(3857),
+        (("f_integer", Layer.FT_INTEGER),),
+        ((1, WKB_POINT_00, (1,)), (2, WKB_POINT_11, (2,))),
+    )
+
+    mreq = MapRequest()
+    mreq.set_crs(CRS.from_epsg(3857))
+    mreq.add_layer(layer, style, filter=flt, filter_extent=flt_extent)
+
+    stat = image_stat(to_pil(mreq.render_image(EXTENT_ONE, (256, 256))))
+    assert (stat.red.max == 255) == present
+
+
+def test_layer_filter_invalid(shared_datadir):
+    layer = Layer.from_ogr(shared_datadir / "poly.geojson")
+    mreq = MapRequest()
+    with pytest.raises(QgisHeadlessError):
+        mreq.add_layer(layer, Style.from_defaults(), filter="(")
+
+
+def test_layer_filter_duplicate(shared_datadir):
+    layer = Layer.from_ogr(shared_datadir / "poly.geojson")
+    mreq = MapRequest()
+    mreq.add_layer(layer, Style.from_defaults(), filter="1 = 1")
+    with pytest.raises(QgisHeadlessError):
+        mreq.add_layer(layer, Style.from_defaults())
+
+    mreq = MapRequest()
+    mreq.add_layer(layer, Style.from_defaults())
+    with pytest.raises(QgisHeadlessError):
+        mreq.add_layer(layer, Style.from_defaults(), filter_extent=(0, 0, 1, 1))
+
+
+def test_band_statistics_cache(shared_datadir, tmp_path):
+    source = shared_datadir / "raster/sochi-aster-dem.tif"
+    style = Style.from_defaults()
+
+    BandStatisticsCache.clear()
+    BandStatisticsCache.set_directory(tmp_path)
+    try:
+        layer = Layer.from_gdal(source)
+        render_raster(layer, style, (40.0, 43.0, 41.0, 44.0), crs=CRS.from_epsg(4326))
+        assert BandStatisticsCache.stats().misses == 1
+        assert len(list(tmp_path.glob("*.json"))) == 1, "Sidecar file missing"
+
+        # Statistics are restored from the sidecar file, as if it was another process
+        BandStatisticsCache.clear()
+        layer = Layer.from_gdal(source)
+        assert BandStatisticsCache.stats().hits == 1
+
+        img = render_raster(layer, style, (40.0, 43.0, 41.0, 44.0), crs=CRS.from_epsg(4326))
+        stat = image_stat(img)
+        assert stat.red.min < stat.red.max, "Contrast enhancement missing"
+    finally:
+        BandStatisticsCache.set_directory("")
+        BandStatisticsCache.clear()
+
+
+def test_band_statistics_cache_cumulative_cut(shared_datadir, tmp_path):
+    source = tmp_path / "dem.tif"
+    copyfile(shared_datadir / "raster/sochi-aster-dem.tif", source)
+    style = Style.from_file(shared_datadir / "raster/cumulative-cut.qml")
+    extent = (40.0, 43.0, 41.0, 44.0)
+    crs = CRS.from_epsg(4326)
+
+    BandStatisticsCache.clear()
+    BandStatisticsCache.set_directory(tmp_path / "statistics")
+    try:
+        # Cumulative cut of the rendering extent is computed from a histogram of the extent
+        expected = render_raster(Layer.from_gdal(source), style, extent, crs=crs)
+        (sidecar,) = (tmp_path / "statistics").glob("*.json")
+        assert len(json.loads(sidecar.read_text())["histograms"]) > 0, "Histogram missing"
+
+        BandStatisticsCache.clear()
+        img = render_raster(Layer.from_gdal(source), style, extent, crs=crs)
+        assert BandStatisticsCache.stats().hits == 1
+        assert img.tobytes() == expected.tobytes()
+
+        # Statistics of the modified file aren't restored
+        BandStatisticsCache.clear()
+        mtime = source.stat().st_mtime
+        os.utime(source, (mtime + 10, mtime + 10))
+        Layer.from_gdal(source)
+        assert BandStatisticsCache.stats().misses == 1
+    finally:
+        BandStatisticsCache.set_directory("")
+        BandStatisticsCache.clear()
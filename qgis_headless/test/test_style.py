@@ -14,6 +14,7 @@ from qgis_headless import (
     SF_SLD,
     Layer,
     Style,
+    StyleCache,
     StyleTypeMismatch,
     StyleValidationError,
     get_qgis_version,
@@ -137,6 +138,11 @@ def test_attributes_default():
     assert attrs == set()
 
 
+def test_attributes_raster(shared_datadir):
+    style = Style.from_file(shared_datadir / "raster/rounds.qml")
+    assert style.used_attributes() == set()
+
+
 @pytest.mark.parametrize(
     "style_fn, expected",
     (
@@ -222,3 +228,59 @@ def test_format(style, fmt, layer_type, exc, shared_datadir):
 )
 def test_sld(style, gt, save_img, shared_datadir):
     Style.from_file(shared_datadir / style, format=SF_SLD, layer_geometry_type=gt)
+
+
+def test_validate_many(shared_datadir):
+    highway = (shared_datadir / "boston/highway.qml").read_text()
+    scale = (shared_datadir / "scale/100_10.qml").read_text()
+    raster = (shared_datadir / "raster/rounds.qml").read_text()
+    sld = (shared_datadir / "boston/highway.sld").read_text()
+
+    results = Style.validate_many(
+        [
+            highway,
+            (scale, Layer.GT_UNKNOWN, LT_VECTOR),
+            (raster, Layer.GT_UNKNOWN, LT_VECTOR),
+            (raster, Layer.GT_UNKNOWN, LT_RASTER),
+            (sld, Layer.GT_UNKNOWN, LT_VECTOR, SF_SLD),
+            "",
+        ]
+    )
+
+    assert [r.valid for r in results] == [True, True, False, True, True, False]
+    assert results[0].used_attributes == {"HIGHWAY"} and results[0].error is None
+    assert results[1].scale_range == (100000, 10000)
+    assert results[2].error is not None
+    assert results[3].used_attributes is None
+    assert results[4].used_attributes == {"HIGHWAY"}
+
+
+def test_memory_usage(shared_datadir):
+    style = Style.from_file(shared_datadir / "contour/simple.qml")
+    assert style.memory_usage() > Style.from_defaults().memory_usage()
+
+
+def test_style_cache(shared_datadir):
+    qml = (shared_datadir / "zero/red-circle.qml").read_text()
+
+    def resolver(path):
+        return path
+
+    StyleCache.clear()
+
+    StyleCache.from_string(qml)
+    StyleCache.from_string(qml)
+    StyleCache.from_string(qml, resolver)
+    StyleCache.from_string(qml, resolver)
+    StyleCache.from_string(qml, lambda path: path)
+    style = StyleCache.from_string(qml, layer_type=LT_VECTOR)
+    assert style.used_attributes() == set()
+
+    stats = StyleCache.stats()
+    assert (stats.hits, stats.misses, stats.size) == (2, 4, 4)
+
+    with pytest.raises(StyleTypeMismatch):
+        StyleCache.from_string(qml, layer_type=LT_RASTER)
+
+    StyleCache.clear()
+    assert StyleCache.stats().size == 0
@@ -34,6 +34,186 @@
 
 namespace py = pybind11;
 
+// Acquires contiguous buffer of Python object, the returned owner releases it holding the GIL
+HeadlessRender::BufferOwner requestBuffer( const py::buffer &buffer, const char *&data, std::size_t &size )
+{
+  py::buffer_info *info = new py::buffer_info( buffer.request() );
+  if ( info->ndim > 1 || ( info->ndim == 1 && info->strides[0] != info->itemsize ) )
+  {
+    delete info;
+    throw py::value_error( "Buffer must be contiguous" );
+  }
+
+  data = static_cast<const char *>( info->ptr );
+  size = static_cast<std::size_t>( info->size * info->itemsize );
+
+  return HeadlessRender::BufferOwner( info, []( py::buffer_info *info ) {
+    py::gil_scoped_acquire acquire;
+    delete info;
+  } );
+}
+
+// Identity of Python SVG resolver, keeping the resolver alive, released holding the GIL
+HeadlessRender::ResolverIdentity resolverIdentity( const py::object &resolver )
+{
+  if ( resolver.is_none() )
+    return nullptr;
+
+  py::object *object = new py::object( resolver );
+  return HeadlessRender::ResolverIdentity( object->ptr(), [object]( const void * ) {
+    py::gil_scoped_acquire acquire;
+    delete object;
+  } );
+}
+
+// SVG resolver for a Python callable, resolving either single path or list of paths. Resolved
+// paths are memoized only if requested, as Python resolvers may depend on external state.
+HeadlessRender::SvgResolver svgResolver(
+  const py::object &resolver, const py::object &batchResolver, bool memoize
+)
+{
+  if ( !resolver.is_none() && !batchResolver.is_none() )
+    throw py::value_error( "svg_resolver and svg_batch_resolver are mutually exclusive" );
+
+  if ( !batchResolver.is_none() )
+    return HeadlessRender::SvgResolver::fromBatch(
+      batchResolver.cast<HeadlessRender::SvgBatchResolverCallback>(),
+      memoize ? resolverIdentity( batchResolver ) : nullptr
+    );
+
+  if ( !resolver.is_none() )
+    return HeadlessRender::SvgResolver(
+      resolver.cast<HeadlessRender::SvgResolverCallback>(),
+      memoize ? resolverIdentity( resolver ) : nullptr
+    );
+
+  return nullptr;
+}
+
+// Used attributes as a set, or None if all attributes are used
+std::optional<std::set<std::string>> usedAttributes(
+  const HeadlessRender::UsedAttributes &attributes
+)
+{
+  if ( attributes.first )
+    return attributes.second;
+  else
+    return std::optional<std::set<std::string>>();
+}
+
+// Scale range as a tuple of denominators, None is used for missing bounds
+py::tuple scaleRange( const HeadlessRender::ScaleRange &range )
+{
+  return py::make_tuple(
+    ( range[0] > 0 ) ? py::cast( range[0] ) : py::none(),
+    ( range[1] > 0 ) ? py::cast( range[1] ) : py::none()
+  );
+}
+
+// Converts (id, wkb, attributes) tuple to feature data of layer with given attributes
+HeadlessRender::Layer::FeatureData toFeatureData(
+  const py::handle &item,
+  const QVector<QPair<QString, HeadlessRender::LayerAttributeType>> &attributeTypes
+)
+{
+  HeadlessRender::Layer::FeatureData feature;
+
+  const py::tuple &feat = item.cast<py::tuple>();
+
+  feature.id = feat[0].cast<qint64>();
+  feature.wkb = feat[1].cast<std::string>();
+
+  int idx = 0;
+  for ( const auto &attr : feat[2] )
+  {
+    HeadlessRender::LayerAttributeType attrType = attributeTypes[idx++].second;
+
+    if ( attr.is_none() )
+    {
+      feature.attributes.append(
+        QVariant( HeadlessRender::layerAttributeTypetoQVariantType( attrType ) )
+      );
+      continue;
+    }
+
+    switch ( attrType )
+    {
+      case HeadlessRender::LayerAttributeType::Integer:
+        feature.attributes.append( attr.cast<int>() );
+        break;
+      case HeadlessRender::LayerAttributeType::Real:
+        feature.attributes.append( attr.cast<double>() );
+        break;
+      case HeadlessRender::LayerAttributeType::String:
+        feature.attributes.append( QString::fromStdString( attr.cast<std::string>() ) );
+        break;
+      case HeadlessRender::LayerAttributeType::Date:
+      {
+        const py::tuple &params = attr.cast<py::tuple>();
+        int y = params[0].cast<int>();
+        int m = params[1].cast<int>();
+        int d = params[2].cast<int>();
+        feature.attributes.append( QDate( y, m, d ) );
+        break;
+      }
+      case HeadlessRender::LayerAttributeType::Time:
+      {
+        const py::tuple &params = attr.cast<py::tuple>();
+        int h = params[0].cast<int>();
+        int m = params[1].cast<int>();
+        int s = params[2].cast<int>();
+        feature.attributes.append( QTime( h, m, s ) );
+        break;
+      }
+      case HeadlessRender::LayerAttributeType::DateTime:
+      {
+        const py::tuple &params = attr.cast<py::tuple>();
+
+        int year = params[0].cast<int>();
+        int month = params[1].cast<int>();
+        int day = params[2].cast<int>();
+        int hour = params[3].cast<int>();
+        int min = params[4].cast<int>();
+        int sec = params[5].cast<int>();
+
+        QDateTime datetime;
+        datetime.setDate( QDate( year, month, day ) );
+        datetime.setTime( QTime( hour, min, sec ) );
+
+        feature.attributes.append( datetime );
+        break;
+      }
+      case HeadlessRender::LayerAttributeType::Integer64:
+        feature.attributes.append( attr.cast<qint64>() );
+        break;
+      case HeadlessRender::LayerAttributeType::Boolean:
+        feature.attributes.append( attr.cast<bool>() );
+        break;
+    }
+  }
+
+  return feature;
+}
+
+// Converts sequence of (id, wkb, attributes) tuples to feature data of layer with given attributes
+QVector<HeadlessRender::Layer::FeatureData> toFeatureDataList(
+  const py::handle &features,
+  const QVector<QPair<QString, HeadlessRender::LayerAttributeType>> &attributeTypes
+)
+{
+  QVector<HeadlessRender::Layer::FeatureData> featureData;
+  for ( const auto &it : features )
+    featureData.append( toFeatureData( it, attributeTypes ) );
+  return featureData;
+}
+
+// Values of raster pixels, exposed through buffer protocol, e.g. to numpy.asarray() without copy
+struct RasterArray
+{
+    std::vector<double> values;
+    std::vector<Py_ssize_t> shape;
+};
+
 PYBIND11_MODULE( _qgis_headless, m )
 {
   py::enum_<HeadlessRender::LogLevel>( m, "LogLevel" )
@@ -56,7 +236,14 @@ PYBIND11_MODULE( _qgis_headless, m )
   py::class_<HeadlessRender::CRS>( m, "CRS" )
     .def( py::init<>() )
     .def_static( "from_epsg", &HeadlessRender::CRS::fromEPSG, py::arg( "epsg" ) )
-    .def_static( "from_wkt", &HeadlessRender::CRS::fromWkt, py::arg( "wkt" ) );
+    .def_static( "from_wkt", &HeadlessRender::CRS::fromWkt, py::arg( "wkt" ) )
+    .def_static( "from_proj", &HeadlessRender::CRS::fromProj, py::arg( "proj" ) );
+
+  py::class_<HeadlessRender::CrsCache>( m, "CrsCache" )
+    .def_static( "set_capacity", &HeadlessRender::CrsCache::setCapacity, py::arg( "capacity" ) )
+    .def_static( "stats", &HeadlessRender::CrsCache::stats )
+    .def_static( "transform_stats", &HeadlessRender::CrsCache::transformStats )
+    .def_static( "clear", &HeadlessRender::CrsCache::clear );
 
   py::class_<HeadlessRender::Layer> layer( m, "Layer" );
 
@@ -104,11 +291,30 @@ PYBIND11_MODULE( _qgis_headless, m )
       []( const py::object &uri ) { return HeadlessRender::Layer::fromGdal( py::str( uri ) ); },
       py::arg( "uri" )
     )
+    .def_static(
+      "from_bytes",
+      []( const py::buffer &buffer, const std::string &driverHint ) {
+        const char *data;
+        std::size_t size;
+        const HeadlessRender::BufferOwner owner = requestBuffer( buffer, data, size );
+        return HeadlessRender::Layer::fromOgrBuffer( data, size, driverHint, owner );
+      },
+      py::arg( "buffer" ), py::arg( "driver_hint" ) = ""
+    )
+    .def_static(
+      "from_gdal_bytes",
+      []( const py::buffer &buffer, const std::string &driverHint ) {
+        const char *data;
+        std::size_t size;
+        const HeadlessRender::BufferOwner owner = requestBuffer( buffer, data, size );
+        return HeadlessRender::Layer::fromGdalBuffer( data, size, driverHint, owner );
+      },
+      py::arg( "buffer" ), py::arg( "driver_hint" ) = ""
+    )
     .def_static(
       "from_data",
-      []( HeadlessRender::LayerGeometryType geometryType, const HeadlessRender::CRS &crs, const py::tuple &attrTypes, const py::tuple &features ) {
+      []( HeadlessRender::LayerGeometryType geometryType, const HeadlessRender::CRS &crs, const py::tuple &attrTypes, const py::tuple &features, const std::vector<double> &detailTolerances ) {
         QVector<QPair<QString, HeadlessRender::LayerAttributeType>> attributeTypes;
-        QVector<HeadlessRender::Layer::FeatureData> featureData;
 
         for ( const auto &it : attrTypes )
         {
@@ -118,94 +324,136 @@ PYBIND11_MODULE( _qgis_headless, m )
           );
         }
 
-        for ( const auto &it : features )
-        {
-          HeadlessRender::Layer::FeatureData feature;
-
-          const py::tuple &feat = it.cast<py::tuple>();
-
-          feature.id = feat[0].cast<qint64>();
-          feature.wkb = feat[1].cast<std::string>();
-
-
-          int idx = 0;
-          for ( const auto &attr : feat[2] )
-          {
-            HeadlessRender::LayerAttributeType attrType = attributeTypes[idx++].second;
-
-            if ( attr.is_none() )
-            {
-              feature.attributes.append(
-                QVariant( HeadlessRender::layerAttributeTypetoQVariantType( attrType ) )
-              );
-              continue;
-            }
-
-            switch ( attrType )
-            {
-              case HeadlessRender::LayerAttributeType::Integer:
-                feature.attributes.append( attr.cast<int>() );
-                break;
-              case HeadlessRender::LayerAttributeType::Real:
-                feature.attributes.append( attr.cast<double>() );
-                break;
-              case HeadlessRender::LayerAttributeType::String:
-                feature.attributes.append( QString::fromStdString( attr.cast<std::string>() ) );
-                break;
-              case HeadlessRender::LayerAttributeType::Date:
-              {
-                const py::tuple &params = attr.cast<py::tuple>();
-                int y = params[0].cast<int>();
-                int m = params[1].cast<int>();
-                int d = params[2].cast<int>();
-                feature.attributes.append( QDate( y, m, d ) );
-                break;
-              }
-              case HeadlessRender::LayerAttributeType::Time:
-              {
-                const py::tuple &params = attr.cast<py::tuple>();
-                int h = params[0].cast<int>();
-                int m = params[1].cast<int>();
-                int s = params[2].cast<int>();
-                feature.attributes.append( QTime( h, m, s ) );
-                break;
-              }
-              case HeadlessRender::LayerAttributeType::DateTime:
-              {
-                const py::tuple &params = attr.cast<py::tuple>();
-
-                int year = params[0].cast<int>();
-                int month = params[1].cast<int>();
-                int day = params[2].cast<int>();
-                int hour = params[3].cast<int>();
-                int min = params[4].cast<int>();
-                int sec = params[5].cast<int>();
-
-                QDateTime datetime;
-                datetime.setDate( QDate( year, month, day ) );
-                datetime.setTime( QTime( hour, min, sec ) );
-
-                feature.attributes.append( datetime );
-                break;
-              }
-              case HeadlessRender::LayerAttributeType::Integer64:
-                feature.attributes.append( attr.cast<qint64>() );
-                break;
-              case HeadlessRender::LayerAttributeType::Boolean:
-                feature.attributes.append( attr.cast<bool>() );
-                break;
-            }
-          }
-
-          featureData.append( feature );
-        }
+        const QVector<HeadlessRender::Layer::FeatureData> featureData = toFeatureDataList( features, attributeTypes );
 
-        return HeadlessRender::Layer::fromData( geometryType, crs, attributeTypes, featureData );
+        return HeadlessRender::Layer::fromData(
+          geometryType, crs, attributeTypes, featureData,
+          QVector<double>( detailTolerances.begin(), detailTolerances.end() )
+        );
       },
       py::arg( "geometry_type" ), py::arg( "crs" ), py::arg( "attribute_types" ),
+      py::arg( "features" ), py::kw_only(), py::arg( "detail_tolerances" ) = std::vector<double>()
+    )
+    .def(
+      "add_features",
+      []( HeadlessRender::Layer &layer, const py::iterable &features ) {
+        return layer.addFeatures( toFeatureDataList( features, layer.attributeTypes() ) );
+      },
       py::arg( "features" )
+    )
+    .def(
+      "update_features",
+      []( HeadlessRender::Layer &layer, const py::iterable &features ) {
+        return layer.updateFeatures( toFeatureDataList( features, layer.attributeTypes() ) );
+      },
+      py::arg( "features" )
+    )
+    .def( "dirty_extents", &HeadlessRender::Layer::dirtyExtents )
+    .def( "clear_dirty_extents", &HeadlessRender::Layer::clearDirtyExtents )
+    .def(
+      "dirty_tiles", &HeadlessRender::Layer::dirtyTiles, py::arg( "style" ), py::arg( "min_zoom" ),
+      py::arg( "max_zoom" ), py::arg( "tile_size" ) = 256, py::arg( "dpi" ) = 96,
+      py::arg( "max_label_length" ) = 64
+    )
+    .def(
+      "delete_features",
+      []( HeadlessRender::Layer &layer, const std::vector<qint64> &ids ) {
+        return layer.deleteFeatures( QVector<qint64>( ids.begin(), ids.end() ) );
+      },
+      py::arg( "ids" )
+    )
+    .def(
+      "set_reprojection_cache", &HeadlessRender::Layer::setReprojectionCache, py::arg( "enabled" )
+    )
+    .def( "reprojection_cache", &HeadlessRender::Layer::reprojectionCache )
+    .def(
+      "build_overviews", &HeadlessRender::Layer::buildOverviews, py::arg( "levels" ),
+      py::arg( "resampling" ) = "AVERAGE", py::kw_only(), py::arg( "external" ) = false
+    )
+    .def(
+      "build_overviews_in_background", &HeadlessRender::Layer::buildOverviewsInBackground,
+      py::arg( "levels" ), py::arg( "resampling" ) = "AVERAGE"
+    )
+    .def( "overview_info", &HeadlessRender::Layer::overviewInfo )
+    .def( "reload", &HeadlessRender::Layer::reload )
+    .def(
+      "sample_raster",
+      []( const HeadlessRender::Layer &layer, const std::vector<std::pair<double, double>> &points,
+          int band ) {
+        std::vector<double> values = layer.sampleRaster( points, band );
+        const Py_ssize_t size = static_cast<Py_ssize_t>( values.size() );
+        return RasterArray { std::move( values ), { size } };
+      },
+      py::arg( "points" ), py::arg( "band" ) = 1
+    )
+    .def(
+      "read_window",
+      []( const HeadlessRender::Layer &layer, const HeadlessRender::Extent &extent,
+          const std::pair<int, int> &size, int band ) {
+        return RasterArray { layer.readWindow( extent, size, band ), { size.second, size.first } };
+      },
+      py::arg( "extent" ), py::arg( "size" ), py::arg( "band" ) = 1
     );
 
+  py::class_<RasterArray>( m, "RasterArray", py::buffer_protocol() )
+    .def_buffer( []( RasterArray &array ) {
+      std::vector<Py_ssize_t> strides( array.shape.size(), sizeof( double ) );
+      for ( std::size_t i = array.shape.size(); i-- > 1; )
+        strides[i - 1] = strides[i] * array.shape[i];
+      return py::buffer_info(
+        array.values.data(), sizeof( double ), py::format_descriptor<double>::format(),
+        static_cast<Py_ssize_t>( array.shape.size() ), array.shape, strides
+      );
+    } )
+    .def_property_readonly( "shape", []( const RasterArray &array ) {
+      return py::tuple( py::cast( array.shape ) );
+    } )
+    .def( "tolist", []( const py::object &array ) {
+      return py::memoryview( array ).attr( "tolist" )();
+    } );
+
+  py::class_<HeadlessRender::OverviewBuild>( m, "OverviewBuild" )
+    .def(
+      "wait",
+      []( const HeadlessRender::OverviewBuild &build ) {
+        py::gil_scoped_release release;
+        build.wait();
+      }
+    )
+    .def( "done", &HeadlessRender::OverviewBuild::done );
+
+  py::class_<HeadlessRender::CacheStats>( m, "CacheStats" )
+    .def_readonly( "hits", &HeadlessRender::CacheStats::hits )
+    .def_readonly( "misses", &HeadlessRender::CacheStats::misses )
+    .def_readonly( "evictions", &HeadlessRender::CacheStats::evictions )
+    .def_readonly( "invalidations", &HeadlessRender::CacheStats::invalidations )
+    .def_readonly( "size", &HeadlessRender::CacheStats::size )
+    .def_readonly( "cost", &HeadlessRender::CacheStats::cost )
+    .def_readonly( "capacity", &HeadlessRender::CacheStats::capacity )
+    .def_property_readonly( "hit_rate", []( const HeadlessRender::CacheStats &stats ) {
+      const std::size_t total = stats.hits + stats.misses;
+      return total > 0 ? static_cast<double>( stats.hits ) / total : 0.0;
+    } );
+
+  py::class_<HeadlessRender::LayerPool>( m, "LayerPool" )
+    .def_static(
+      "from_ogr",
+      []( const py::object &uri, const HeadlessRender::OpenOptions &openOptions ) {
+        return HeadlessRender::LayerPool::fromOgr( py::str( uri ), openOptions );
+      },
+      py::arg( "uri" ), py::arg( "open_options" ) = HeadlessRender::OpenOptions()
+    )
+    .def_static(
+      "from_gdal",
+      []( const py::object &uri, const HeadlessRender::OpenOptions &openOptions ) {
+        return HeadlessRender::LayerPool::fromGdal( py::str( uri ), openOptions );
+      },
+      py::arg( "uri" ), py::arg( "open_options" ) = HeadlessRender::OpenOptions()
+    )
+    .def_static( "set_capacity", &HeadlessRender::LayerPool::setCapacity, py::arg( "capacity" ) )
+    .def_static( "stats", &HeadlessRender::LayerPool::stats )
+    .def_static( "clear", &HeadlessRender::LayerPool::clear );
+
   py::class_<HeadlessRender::Image, std::shared_ptr<HeadlessRender::Image>>( m, "Image" )
     .def( "size", &HeadlessRender::Image::sizeWidthHeight )
     .def( "to_bytes", []( std::shared_ptr<HeadlessRender::Image> img ) {
@@ -220,44 +468,80 @@ PYBIND11_MODULE( _qgis_headless, m )
 
   py::class_<HeadlessRender::Style>( m, "Style" )
     .def_static(
-      "from_string", &HeadlessRender::Style::fromString, py::arg( "string" ),
-      py::arg( "svg_resolver" ) = nullptr,
+      "from_string",
+      [](
+        const std::string &data, const py::object &resolver,
+        HeadlessRender::LayerGeometryType layerGeometryType, HeadlessRender::DataType layerType,
+        HeadlessRender::StyleFormat format, const py::object &batchResolver
+      ) {
+        return HeadlessRender::Style::fromString(
+          data, svgResolver( resolver, batchResolver, false ), layerGeometryType, layerType, format
+        );
+      },
+      py::arg( "string" ), py::arg( "svg_resolver" ) = py::none(),
       py::arg( "layer_geometry_type" ) = HeadlessRender::LayerGeometryType::Unknown,
       py::arg( "layer_type" ) = HeadlessRender::DataType::Unknown,
-      py::arg( "format" ) = HeadlessRender::StyleFormat::QML
+      py::arg( "format" ) = HeadlessRender::StyleFormat::QML, py::kw_only(),
+      py::arg( "svg_batch_resolver" ) = py::none()
     )
     .def_static(
       "from_file",
       [](
-        const py::object &filePath, const HeadlessRender::SvgResolverCallback &svgResolverCallback,
+        const py::object &filePath, const py::object &resolver,
         HeadlessRender::LayerGeometryType layerGeometryType, HeadlessRender::DataType layerType,
-        HeadlessRender::StyleFormat format
+        HeadlessRender::StyleFormat format, const py::object &batchResolver
       ) {
-        return HeadlessRender::Style::
-          fromFile( py::str( filePath ), svgResolverCallback, layerGeometryType, layerType, format );
+        return HeadlessRender::Style::fromFile(
+          py::str( filePath ), svgResolver( resolver, batchResolver, false ), layerGeometryType,
+          layerType, format
+        );
       },
-      py::arg( "file_path" ), py::arg( "svg_resolver" ) = nullptr,
+      py::arg( "file_path" ), py::arg( "svg_resolver" ) = py::none(),
       py::arg( "layer_geometry_type" ) = HeadlessRender::LayerGeometryType::Unknown,
       py::arg( "layer_type" ) = HeadlessRender::DataType::Unknown,
-      py::arg( "format" ) = HeadlessRender::StyleFormat::QML
+      py::arg( "format" ) = HeadlessRender::StyleFormat::QML, py::kw_only(),
+      py::arg( "svg_batch_resolver" ) = py::none()
     )
     .def(
       "used_attributes",
-      []( const HeadlessRender::Style &style ) -> std::optional<std::set<std::string>> {
-        const auto &result = style.usedAttributes();
-        if ( result.first )
-          return result.second;
-        else
-          return std::optional<std::set<std::string>>();
-      }
+      []( const HeadlessRender::Style &style ) { return usedAttributes( style.usedAttributes() ); }
     )
     .def(
       "scale_range",
-      []( const HeadlessRender::Style &style ) -> py::tuple {
-        const auto &result = style.scaleRange();
-        return py::
-          make_tuple( ( result[0] > 0 ) ? py::cast( result[0] ) : py::none(), ( result[1] > 0 ) ? py::cast( result[1] ) : py::none() );
-      }
+      []( const HeadlessRender::Style &style ) { return scaleRange( style.scaleRange() ); }
+    )
+    .def( "needs_source_features", &HeadlessRender::Style::needsSourceFeatures )
+    .def_static(
+      "validate_many",
+      []( const py::iterable &styles ) {
+        std::vector<HeadlessRender::Style::ValidationRequest> requests;
+        for ( const py::handle &item : styles )
+        {
+          HeadlessRender::Style::ValidationRequest request;
+          if ( py::isinstance<py::str>( item ) )
+            request.data = item.cast<std::string>();
+          else
+          {
+            const py::tuple &style = item.cast<py::tuple>();
+            request.data = style[0].cast<std::string>();
+            if ( style.size() > 1 )
+              request.layerGeometryType = style[1].cast<HeadlessRender::LayerGeometryType>();
+            if ( style.size() > 2 )
+              request.layerType = style[2].cast<HeadlessRender::DataType>();
+            if ( style.size() > 3 )
+              request.format = style[3].cast<HeadlessRender::StyleFormat>();
+          }
+          requests.push_back( std::move( request ) );
+        }
+
+        std::vector<HeadlessRender::Style::ValidationResult> results;
+        {
+          py::gil_scoped_release release;
+          results = HeadlessRender::Style::validateMany( requests );
+        }
+        return results;
+      },
+      py::arg( "styles" )
     )
     .def_static(
       "from_defaults",
@@ -279,6 +563,12 @@ PYBIND11_MODULE( _qgis_headless, m )
       py::arg( "layer_geometry_type" ) = HeadlessRender::LayerGeometryType::Unknown,
       py::arg( "layer_type" ) = HeadlessRender::DataType::Unknown
     )
+    .def(
+      "max_bleed", &HeadlessRender::Style::maxBleed, py::arg( "dpi" ) = 96,
+      py::arg( "max_label_length" ) = 64
+    )
+    .def( "memory_usage", &HeadlessRender::Style::memoryUsage )
+    .def( "with_memoized_expressions", &HeadlessRender::Style::withMemoizedExpressions )
     .def(
       "to_string",
       []( const HeadlessRender::Style &style, const HeadlessRender::StyleFormat format ) {
@@ -287,6 +577,78 @@ PYBIND11_MODULE( _qgis_headless, m )
       py::arg( "format" ) = HeadlessRender::StyleFormat::QML
     );
 
+  py::class_<HeadlessRender::Style::ValidationResult>( m, "StyleValidationResult" )
+    .def_readonly( "valid", &HeadlessRender::Style::ValidationResult::valid )
+    .def_property_readonly(
+      "error",
+      []( const HeadlessRender::Style::ValidationResult &result ) -> std::optional<std::string> {
+        if ( result.error.empty() )
+          return std::nullopt;
+        return result.error;
+      }
+    )
+    .def_property_readonly(
+      "used_attributes",
+      []( const HeadlessRender::Style::ValidationResult &result ) {
+        return result.usedAttributes ? usedAttributes( *result.usedAttributes )
+                                     : std::optional<std::set<std::string>>();
+      }
+    )
+    .def_property_readonly(
+      "scale_range",
+      []( const HeadlessRender::Style::ValidationResult &result ) {
+        return scaleRange( result.scaleRange );
+      }
+    );
+
+  py::class_<HeadlessRender::StyleCache>( m, "StyleCache" )
+    .def_static(
+      "from_string",
+      [](
+        const std::string &data, const py::object &resolver,
+        HeadlessRender::LayerGeometryType layerGeometryType, HeadlessRender::DataType layerType,
+        HeadlessRender::StyleFormat format, const py::object &batchResolver
+      ) {
+        return HeadlessRender::StyleCache::fromString(
+          data, svgResolver( resolver, batchResolver, true ), layerGeometryType, layerType, format
+        );
+      },
+      py::arg( "string" ), py::arg( "svg_resolver" ) = py::none(),
+      py::arg( "layer_geometry_type" ) = HeadlessRender::LayerGeometryType::Unknown,
+      py::arg( "layer_type" ) = HeadlessRender::DataType::Unknown,
+      py::arg( "format" ) = HeadlessRender::StyleFormat::QML, py::kw_only(),
+      py::arg( "svg_batch_resolver" ) = py::none()
+    )
+    .def_static( "set_capacity", &HeadlessRender::StyleCache::setCapacity, py::arg( "capacity" ) )
+    .def_static( "stats", &HeadlessRender::StyleCache::stats )
+    .def_static( "clear", &HeadlessRender::StyleCache::clear );
+
+  py::class_<HeadlessRender::SymbolCache>( m, "SymbolCache" )
+    .def_static(
+      "preload", &HeadlessRender::SymbolCache::preload, py::arg( "style" ), py::arg( "dpi" ) = 96,
+      py::arg( "sizes" ) = std::vector<int>()
+    );
+
+  py::class_<HeadlessRender::SvgResolver>( m, "SvgResolver" )
+    .def_static( "set_capacity", &HeadlessRender::SvgResolver::setCapacity, py::arg( "capacity" ) )
+    .def_static( "stats", &HeadlessRender::SvgResolver::stats )
+    .def_static( "clear", &HeadlessRender::SvgResolver::clear );
+
+  py::class_<HeadlessRender::ExpressionTiming>( m, "ExpressionTiming" )
+    .def_readonly( "expression", &HeadlessRender::ExpressionTiming::expression )
+    .def_readonly( "evaluations", &HeadlessRender::ExpressionTiming::evaluations )
+    .def_readonly( "hits", &HeadlessRender::ExpressionTiming::hits )
+    .def_readonly( "prepare_time", &HeadlessRender::ExpressionTiming::prepareTime )
+    .def_readonly( "evaluate_time", &HeadlessRender::ExpressionTiming::evaluateTime );
+
+  py::class_<HeadlessRender::ExpressionCache>( m, "ExpressionCache" )
+    .def_static(
+      "set_capacity", &HeadlessRender::ExpressionCache::setCapacity, py::arg( "capacity" )
+    )
+    .def_static( "stats", &HeadlessRender::ExpressionCache::stats )
+    .def_static( "timings", &HeadlessRender::ExpressionCache::timings )
+    .def_static( "clear", &HeadlessRender::ExpressionCache::clear );
+
   py::class_<HeadlessRender::LegendSymbol>( m, "LegendSymbol" )
     .def( "icon", &HeadlessRender::LegendSymbol::icon )
     .def(
@@ -317,6 +679,37 @@ PYBIND11_MODULE( _qgis_headless, m )
     )
     .def( "raster_band", &HeadlessRender::LegendSymbol::rasterBand );
 
+  py::class_<HeadlessRender::LegendCache>( m, "LegendCache" )
+    .def_static( "set_capacity", &HeadlessRender::LegendCache::setCapacity, py::arg( "capacity" ) )
+    .def_static( "stats", &HeadlessRender::LegendCache::stats )
+    .def_static( "clear", &HeadlessRender::LegendCache::clear );
+
+  py::class_<HeadlessRender::RasterBlockCache>( m, "RasterBlockCache" )
+    .def_static(
+      "set_capacity", &HeadlessRender::RasterBlockCache::setCapacity, py::arg( "capacity" )
+    )
+    .def_static( "stats", &HeadlessRender::RasterBlockCache::stats )
+    .def_static( "clear", &HeadlessRender::RasterBlockCache::clear );
+
+  py::class_<HeadlessRender::BandStatisticsCache>( m, "BandStatisticsCache" )
+    .def_static(
+      "set_directory",
+      []( const py::object &path ) {
+        HeadlessRender::BandStatisticsCache::setDirectory( py::str( path ) );
+      },
+      py::arg( "path" )
+    )
+    .def_static( "directory", &HeadlessRender::BandStatisticsCache::directory )
+    .def_static(
+      "set_capacity", &HeadlessRender::BandStatisticsCache::setCapacity, py::arg( "capacity" )
+    )
+    .def_static( "stats", &HeadlessRender::BandStatisticsCache::stats )
+    .def_static( "clear", &HeadlessRender::BandStatisticsCache::clear );
+
+  py::class_<HeadlessRender::LegendSprite>( m, "LegendSprite" )
+    .def_readonly( "image", &HeadlessRender::LegendSprite::image )
+    .def_readonly( "index", &HeadlessRender::LegendSprite::index );
+
   py::class_<HeadlessRender::RawData, std::shared_ptr<HeadlessRender::RawData>>( m, "RawData" )
     .def( py::init<>() )
     .def( "size", &HeadlessRender::RawData::size )
@@ -338,7 +731,10 @@ PYBIND11_MODULE( _qgis_headless, m )
     .def( py::init<>() )
     .def( "set_dpi", &HeadlessRender::MapRequest::setDpi, py::arg( "dpi" ) )
     .def( "set_crs", &HeadlessRender::MapRequest::setCrs, py::arg( "crs" ) )
-    .def( "add_layer", &HeadlessRender::MapRequest::addLayer, py::arg( "layer" ), py::arg( "style" ), py::arg( "label" ) = "" )
+    .def(
+      "add_layer", &HeadlessRender::MapRequest::addLayer, py::arg( "layer" ), py::arg( "style" ),
+      py::arg( "label" ) = "", py::kw_only(), py::arg( "filter" ) = "", py::arg( "filter_extent" ) = py::none()
+    )
     .def( "add_project", &HeadlessRender::MapRequest::addProject, py::arg( "project" ) )
     .def(
       "render_image",
@@ -368,6 +764,11 @@ PYBIND11_MODULE( _qgis_headless, m )
       "legend_symbols", &HeadlessRender::MapRequest::legendSymbols, py::arg( "index" ),
       py::arg( "size" ) = HeadlessRender::Size(),
       py::arg( "count" ) = HeadlessRender::DefaultRasterRenderSymbolCount
+    )
+    .def(
+      "legend_sprite", &HeadlessRender::MapRequest::legendSprite, py::arg( "size" ),
+      py::arg( "dpi" ) = py::none(),
+      py::arg( "count" ) = HeadlessRender::DefaultRasterRenderSymbolCount
     );
 
   m.def(
@@ -384,6 +785,23 @@ PYBIND11_MODULE( _qgis_headless, m )
 
   m.def( "deinit", &HeadlessRender::deinit, "Library deinitialization" );
 
+  // Cached objects hold Python objects and QGIS layers, which must be released before interpreter
+  // finalization, even if deinit() was not called
+  py::module_::import( "atexit" ).attr( "register" )( py::cpp_function( []() {
+    {
+      py::gil_scoped_release release;
+      HeadlessRender::Layer::waitForOverviewBuilds();
+    }
+    HeadlessRender::LayerPool::clear();
+    HeadlessRender::StyleCache::clear();
+    HeadlessRender::SvgResolver::clear();
+    HeadlessRender::ExpressionCache::clear();
+    HeadlessRender::LegendCache::clear();
+    HeadlessRender::CrsCache::clear();
+    HeadlessRender::RasterBlockCache::clear();
+    HeadlessRender::BandStatisticsCache::clear();
+  } ) );
+
   m.def( "set_svg_paths", &HeadlessRender::setSvgPaths, "Set SVG search paths", py::arg( "paths" ) );
 
   m.def( "get_svg_paths", &HeadlessRender::getSvgPaths, "Get SVG search paths" );
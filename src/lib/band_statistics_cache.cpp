@@ -0,0 +1,432 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "band_statistics_cache.h"
+#include "lru_cache.h"
+#include "utils.h"
+
+#include <qgsrasterbandstats.h>
+#include <qgsrasterdataprovider.h>
+#include <qgsrasterhistogram.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+  const std::size_t DEFAULT_CAPACITY = 256;
+
+  // Statistics of rendering extents accumulate, so only the latest of them are kept per source
+  constexpr int MaxSourceItems = 256;
+
+  struct QStringHash
+  {
+      std::size_t operator()( const QString &string ) const
+      {
+        return qHash( string );
+      }
+  };
+
+  struct SourceStatistics
+  {
+      HeadlessRender::SourceState state; // state of the source file, statistics were computed for
+      QList<QgsRasterBandStats> statistics;
+      QList<QgsRasterHistogram> histograms;
+  };
+
+  typedef std::shared_ptr<SourceStatistics> SourceStatisticsPtr;
+  typedef HeadlessRender::LruCache<QString, SourceStatisticsPtr, QStringHash> Cache;
+
+  std::mutex cacheMutex;
+  Cache cache( DEFAULT_CAPACITY );
+  QString sidecarDirectory;
+  std::size_t restoreHits = 0;
+  std::size_t restoreMisses = 0;
+
+  // Statistics and histograms are kept by providers in protected members of QgsRasterInterface
+  struct ProviderAccess : QgsRasterInterface
+  {
+      static QList<QgsRasterBandStats> &statistics( QgsRasterInterface *interface )
+      {
+        return interface->*( &ProviderAccess::mStatistics );
+      }
+
+      static QList<QgsRasterHistogram> &histograms( QgsRasterInterface *interface )
+      {
+        return interface->*( &ProviderAccess::mHistograms );
+      }
+  };
+
+#if _QGIS_VERSION_INT < 33600
+  int gatheredStatistics( const QgsRasterBandStats &stats )
+  {
+    return stats.statsGathered;
+  }
+
+  void setGatheredStatistics( QgsRasterBandStats &stats, int gathered )
+  {
+    stats.statsGathered = gathered;
+  }
+#else
+  int gatheredStatistics( const QgsRasterBandStats &stats )
+  {
+    return static_cast<int>( stats.statsGathered );
+  }
+
+  void setGatheredStatistics( QgsRasterBandStats &stats, int gathered )
+  {
+    stats.statsGathered = Qgis::RasterBandStatistics( QFlag( gathered ) );
+  }
+#endif
+
+  bool sameStatistics( const QgsRasterBandStats &a, const QgsRasterBandStats &b )
+  {
+    return a.bandNumber == b.bandNumber && a.width == b.width && a.height == b.height
+           && a.extent == b.extent;
+  }
+
+  bool sameHistogram( const QgsRasterHistogram &a, const QgsRasterHistogram &b )
+  {
+    return a.bandNumber == b.bandNumber && a.binCount == b.binCount
+           && a.includeOutOfRange == b.includeOutOfRange && a.minimum == b.minimum
+           && a.maximum == b.maximum && a.width == b.width && a.height == b.height
+           && a.extent == b.extent;
+  }
+
+  // Adds items missing in the list, replaces ones with less gathered statistics
+  bool mergeStatistics( QList<QgsRasterBandStats> &list, const QList<QgsRasterBandStats> &items )
+  {
+    bool changed = false;
+    for ( const QgsRasterBandStats &item : items )
+    {
+      auto it = std::find_if( list.begin(), list.end(), [&item]( const QgsRasterBandStats &s ) {
+        return sameStatistics( s, item );
+      } );
+      const int gathered = it != list.end() ? gatheredStatistics( *it ) : 0;
+      if ( it == list.end() )
+        list.append( item );
+      else if ( ( gathered | gatheredStatistics( item ) ) != gathered )
+        *it = item;
+      else
+        continue;
+      changed = true;
+    }
+
+    while ( list.size() > MaxSourceItems )
+      list.removeFirst();
+    return changed;
+  }
+
+  bool mergeHistograms( QList<QgsRasterHistogram> &list, const QList<QgsRasterHistogram> &items )
+  {
+    bool changed = false;
+    for ( const QgsRasterHistogram &item : items )
+    {
+      if ( !item.valid )
+        continue;
+
+      const bool known = std::any_of( list.begin(), list.end(), [&item]( const auto &h ) {
+        return sameHistogram( h, item );
+      } );
+      if ( known )
+        continue;
+
+      list.append( item );
+      changed = true;
+    }
+
+    while ( list.size() > MaxSourceItems )
+      list.removeFirst();
+    return changed;
+  }
+
+  QJsonArray extentToJson( const QgsRectangle &extent )
+  {
+    return { extent.xMinimum(), extent.yMinimum(), extent.xMaximum(), extent.yMaximum() };
+  }
+
+  QgsRectangle extentFromJson( const QJsonValue &value )
+  {
+    const QJsonArray array = value.toArray();
+    return QgsRectangle(
+      array.at( 0 ).toDouble(), array.at( 1 ).toDouble(), array.at( 2 ).toDouble(),
+      array.at( 3 ).toDouble()
+    );
+  }
+
+  // Entries of sources, which files were modified since, are dropped from the cache
+  std::function<bool( const SourceStatisticsPtr & )> isCurrent(
+    const HeadlessRender::SourceState &state
+  )
+  {
+    return [state]( const SourceStatisticsPtr &entry ) { return entry->state == state; };
+  }
+
+  // Sidecar files are named by hash of sources' URIs, in-memory sources are not persisted
+  QString sidecarPath( const QString &source )
+  {
+    if ( sidecarDirectory.isEmpty() || source.startsWith( QLatin1String( "/vsimem/" ) ) )
+      return QString();
+
+    const QByteArray hash = QCryptographicHash::hash( source.toUtf8(), QCryptographicHash::Sha1 );
+    return QDir( sidecarDirectory ).filePath( QString::fromLatin1( hash.toHex() ) + ".json" );
+  }
+
+  void writeSidecar( const QString &source, const SourceStatistics &entry )
+  {
+    const QString path = sidecarPath( source );
+    if ( path.isEmpty() )
+      return;
+
+    QJsonArray statistics;
+    for ( const QgsRasterBandStats &stats : entry.statistics )
+    {
+      statistics.append( QJsonObject {
+        { "band", stats.bandNumber },
+        { "gathered", gatheredStatistics( stats ) },
+        { "count", static_cast<double>( stats.elementCount ) },
+        { "min", stats.minimumValue },
+        { "max", stats.maximumValue },
+        { "range", stats.range },
+        { "mean", stats.mean },
+        { "stddev", stats.stdDev },
+        { "sum", stats.sum },
+        { "sum_of_squares", stats.sumOfSquares },
+        { "width", stats.width },
+        { "height", stats.height },
+        { "extent", extentToJson( stats.extent ) },
+      } );
+    }
+
+    QJsonArray histograms;
+    for ( const QgsRasterHistogram &histogram : entry.histograms )
+    {
+      QJsonArray counts;
+      for ( const auto count : histogram.histogramVector )
+        counts.append( static_cast<double>( count ) );
+
+      histograms.append( QJsonObject {
+        { "band", histogram.bandNumber },
+        { "bins", histogram.binCount },
+        { "count", histogram.nonNullCount },
+        { "include_out_of_range", histogram.includeOutOfRange },
+        { "min", histogram.minimum },
+        { "max", histogram.maximum },
+        { "width", histogram.width },
+        { "height", histogram.height },
+        { "extent", extentToJson( histogram.extent ) },
+        { "counts", counts },
+      } );
+    }
+
+    const QJsonObject document {
+      { "source", source },
+      { "mtime", static_cast<double>( entry.state.mtime ) },
+      { "size", static_cast<double>( entry.state.size ) },
+      { "statistics", statistics },
+      { "histograms", histograms },
+    };
+
+    // Statistics are an optimization, so failures to persist them are ignored
+    QDir().mkpath( sidecarDirectory );
+    QSaveFile file( path );
+    if ( !file.open( QIODevice::WriteOnly ) )
+      return;
+    file.write( QJsonDocument( document ).toJson( QJsonDocument::Compact ) );
+    file.commit();
+  }
+
+  SourceStatisticsPtr readSidecar(
+    const QString &source, const HeadlessRender::SourceState &state
+  )
+  {
+    const QString path = sidecarPath( source );
+    if ( path.isEmpty() )
+      return nullptr;
+
+    QFile file( path );
+    if ( !file.open( QIODevice::ReadOnly ) )
+      return nullptr;
+
+    const QJsonObject document = QJsonDocument::fromJson( file.readAll() ).object();
+    // Hashes of different sources may collide
+    if ( document.value( "source" ).toString() != source )
+      return nullptr;
+
+    // Statistics of the file, which was modified since, are stale
+    if ( static_cast<qint64>( document.value( "mtime" ).toDouble( -1 ) ) != state.mtime
+         || static_cast<qint64>( document.value( "size" ).toDouble( -1 ) ) != state.size )
+      return nullptr;
+
+    auto entry = std::make_shared<SourceStatistics>();
+    entry->state = state;
+    for ( const QJsonValue &value : document.value( "statistics" ).toArray() )
+    {
+      const QJsonObject object = value.toObject();
+      QgsRasterBandStats stats;
+      stats.bandNumber = object.value( "band" ).toInt();
+      setGatheredStatistics( stats, object.value( "gathered" ).toInt() );
+      stats.elementCount = static_cast<qgssize>( object.value( "count" ).toDouble() );
+      stats.minimumValue = object.value( "min" ).toDouble();
+      stats.maximumValue = object.value( "max" ).toDouble();
+      stats.range = object.value( "range" ).toDouble();
+      stats.mean = object.value( "mean" ).toDouble();
+      stats.stdDev = object.value( "stddev" ).toDouble();
+      stats.sum = object.value( "sum" ).toDouble();
+      stats.sumOfSquares = object.value( "sum_of_squares" ).toDouble();
+      stats.width = object.value( "width" ).toInt();
+      stats.height = object.value( "height" ).toInt();
+      stats.extent = extentFromJson( object.value( "extent" ) );
+      entry->statistics.append( stats );
+    }
+
+    for ( const QJsonValue &value : document.value( "histograms" ).toArray() )
+    {
+      const QJsonObject object = value.toObject();
+      QgsRasterHistogram histogram;
+      histogram.bandNumber = object.value( "band" ).toInt();
+      histogram.binCount = object.value( "bins" ).toInt();
+      histogram.nonNullCount = object.value( "count" ).toInt();
+      histogram.includeOutOfRange = object.value( "include_out_of_range" ).toBool();
+      histogram.minimum = object.value( "min" ).toDouble();
+      histogram.maximum = object.value( "max" ).toDouble();
+      histogram.width = object.value( "width" ).toInt();
+      histogram.height = object.value( "height" ).toInt();
+      histogram.extent = extentFromJson( object.value( "extent" ) );
+      for ( const QJsonValue &count : object.value( "counts" ).toArray() )
+        histogram.histogramVector.append(
+          static_cast<QgsRasterHistogram::HistogramVector::value_type>( count.toDouble() )
+        );
+      histogram.valid = histogram.histogramVector.size() == histogram.binCount;
+      if ( histogram.valid )
+        entry->histograms.append( histogram );
+    }
+
+    return entry;
+  }
+} // namespace
+
+void HeadlessRender::BandStatisticsCache::restore( QgsRasterDataProvider *provider )
+{
+  const QString source = provider->dataSourceUri();
+  const SourceState state = sourceState( source );
+
+  SourceStatisticsPtr entry;
+  {
+    std::lock_guard<std::mutex> lock( cacheMutex );
+    if ( std::optional<SourceStatisticsPtr> cached = cache.get( source, isCurrent( state ) ) )
+      entry = *cached;
+    else if ( ( entry = readSidecar( source, state ) ) )
+      cache.put( source, entry );
+
+    if ( !entry || ( entry->statistics.isEmpty() && entry->histograms.isEmpty() ) )
+    {
+      ++restoreMisses;
+      return;
+    }
+    ++restoreHits;
+
+    mergeStatistics( ProviderAccess::statistics( provider ), entry->statistics );
+    mergeHistograms( ProviderAccess::histograms( provider ), entry->histograms );
+  }
+}
+
+void HeadlessRender::BandStatisticsCache::store( QgsRasterDataProvider *provider )
+{
+  const QList<QgsRasterBandStats> &statistics = ProviderAccess::statistics( provider );
+  const QList<QgsRasterHistogram> &histograms = ProviderAccess::histograms( provider );
+  if ( statistics.isEmpty() && histograms.isEmpty() )
+    return;
+
+  const QString source = provider->dataSourceUri();
+  const SourceState state = sourceState( source );
+
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  SourceStatisticsPtr entry;
+  if ( std::optional<SourceStatisticsPtr> cached = cache.get( source, isCurrent( state ) ) )
+    entry = *cached;
+  else
+  {
+    entry = std::make_shared<SourceStatistics>();
+    entry->state = state;
+    cache.put( source, entry );
+  }
+
+  const bool statisticsChanged = mergeStatistics( entry->statistics, statistics );
+  const bool histogramsChanged = mergeHistograms( entry->histograms, histograms );
+  if ( statisticsChanged || histogramsChanged )
+    writeSidecar( source, *entry );
+}
+
+void HeadlessRender::BandStatisticsCache::invalidate( const QString &source )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.remove( source );
+
+  const QString path = sidecarPath( source );
+  if ( !path.isEmpty() )
+    QFile::remove( path );
+}
+
+void HeadlessRender::BandStatisticsCache::setDirectory( const std::string &path )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  sidecarDirectory = QString::fromStdString( path );
+}
+
+std::string HeadlessRender::BandStatisticsCache::directory()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return sidecarDirectory.toStdString();
+}
+
+void HeadlessRender::BandStatisticsCache::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.setCapacity( capacity );
+}
+
+HeadlessRender::CacheStats HeadlessRender::BandStatisticsCache::stats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  CacheStats stats = cache.stats();
+  stats.hits = restoreHits;
+  stats.misses = restoreMisses;
+  return stats;
+}
+
+void HeadlessRender::BandStatisticsCache::clear()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.clear();
+  cache.resetStats();
+  restoreHits = 0;
+  restoreMisses = 0;
+}
@@ -0,0 +1,92 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_BAND_STATISTICS_CACHE_H
+#define QGIS_HEADLESS_BAND_STATISTICS_CACHE_H
+
+#include <string>
+#include <QString>
+#include "types.h"
+
+class QgsRasterDataProvider;
+
+namespace HeadlessRender
+{
+  /**
+   * Process-wide thread-safe cache of band statistics and histograms of raster sources, used by
+   * contrast enhancement of raster styles. Values are kept per source, band and extent (either
+   * the whole raster or an extent of rendering) and optionally persisted in sidecar files of a
+   * directory, so that new processes opening the same source don't compute them again.
+   * Values of source files are dropped, when modification time or size of the file changes.
+   */
+  class QGIS_HEADLESS_EXPORT BandStatisticsCache
+  {
+    public:
+      /**
+       * Passes statistics and histograms, known for the provider's source, to the provider, which
+       * reuses them instead of computing.
+       */
+      static void restore( QgsRasterDataProvider *provider );
+
+      /**
+       * Remembers statistics and histograms computed by the provider, writing the sidecar file if
+       * anything new was computed.
+       */
+      static void store( QgsRasterDataProvider *provider );
+
+      /**
+       * Removes statistics of the source from memory and its sidecar file, e.g. after the source
+       * was reloaded.
+       */
+      static void invalidate( const QString &source );
+
+      /**
+       * Sets directory of sidecar files, empty path disables persistence.
+       */
+      static void setDirectory( const std::string &path );
+
+      /**
+       * Returns directory of sidecar files, or empty string if persistence is disabled.
+       */
+      static std::string directory();
+
+      /**
+       * Sets maximum number of sources, which statistics are kept in memory,
+       * least recently used sources are evicted.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns hit, miss and eviction counters of the cache. Restoring a source counts as a hit,
+       * if its statistics were found either in memory or in a sidecar file.
+       */
+      static CacheStats stats();
+
+      /**
+       * Removes all statistics from memory and resets counters, sidecar files are kept.
+       */
+      static void clear();
+
+    private:
+      BandStatisticsCache() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_BAND_STATISTICS_CACHE_H
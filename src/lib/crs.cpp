@@ -19,6 +19,7 @@
 ******************************************************************************/
 
 #include "crs.h"
+#include "crs_cache.h"
 #include "exceptions.h"
 #include <qgscoordinatereferencesystem.h>
 #include <QString>
@@ -30,34 +31,53 @@ static const QString EPSG_4326 = "PROJ: +proj=longlat +datum=WGS84 +no_def";
 
 HeadlessRender::CRS HeadlessRender::CRS::fromEPSG( long epsg )
 {
+  // Web Mercator and WGS 84 keep their historical PROJ definitions, so rendering doesn't change
   CRS crs;
+  crs.mCRS = CrsCache::crs( QStringLiteral( "EPSG:%1" ).arg( epsg ), [epsg]() {
+    switch ( epsg )
+    {
+      case 3857:
+        return QgsCoordinateReferenceSystem( EPSG_3857 );
+      case 4326:
+        return QgsCoordinateReferenceSystem( EPSG_4326 );
+      default:
+        return QgsCoordinateReferenceSystem::fromEpsgId( epsg );
+    }
+  } );
 
-  switch ( epsg )
-  {
-    case 3857:
-      crs.mCRS = std::make_shared<QgsCoordinateReferenceSystem>( EPSG_3857 );
-      break;
-    case 4326:
-      crs.mCRS = std::make_shared<QgsCoordinateReferenceSystem>( EPSG_4326 );
-      break;
-    default:
-      throw InvalidCRSError( "Invalid epsg code" );
-      break;
-  }
+  if ( !crs.mCRS )
+    throw InvalidCRSError( "Invalid epsg code" );
 
   return crs;
 }
 
 HeadlessRender::CRS HeadlessRender::CRS::fromWkt( const std::string &wkt )
 {
+  const QString definition = QString::fromStdString( wkt ).trimmed();
+
   CRS crs;
-  crs.mCRS = std::make_shared<QgsCoordinateReferenceSystem>(
-    QgsCoordinateReferenceSystem::fromWkt( QString::fromStdString( wkt ) )
-  );
-  if ( !crs.mCRS->isValid() )
-  {
-    throw InvalidCRSError( "Invalid wkt definition: '" + crs.mCRS->toWkt() + "'" );
-  }
+  crs.mCRS = CrsCache::crs( QStringLiteral( "WKT:" ) + definition, [&definition]() {
+    return QgsCoordinateReferenceSystem::fromWkt( definition );
+  } );
+
+  if ( !crs.mCRS )
+    throw InvalidCRSError( "Invalid wkt definition: '" + definition + "'" );
+
+  return crs;
+}
+
+HeadlessRender::CRS HeadlessRender::CRS::fromProj( const std::string &proj )
+{
+  const QString definition = QString::fromStdString( proj ).simplified();
+
+  CRS crs;
+  crs.mCRS = CrsCache::crs( QStringLiteral( "PROJ:" ) + definition, [&definition]() {
+    return QgsCoordinateReferenceSystem::fromProj( definition );
+  } );
+
+  if ( !crs.mCRS )
+    throw InvalidCRSError( "Invalid proj definition: '" + definition + "'" );
+
   return crs;
 }
 
@@ -32,12 +32,13 @@ namespace HeadlessRender
 
   /**
    * This class represents a coordinate reference system (CRS).
+   * CRSes are cached by definitions and shared, see CrsCache.
   */
   class QGIS_HEADLESS_EXPORT CRS
   {
     public:
       /**
-       * Creates a CRS from a given EPSG ID.
+       * Creates a CRS from a given EPSG ID, found in the PROJ database.
        * \param epsg EPSG ID for the desired spatial reference system.
        * \returns matching CRS, or throw an exception InvalidCRSError, if epsg is not a valid EPSG ID.
        * \throws InvalidCRSError
@@ -52,6 +53,14 @@ namespace HeadlessRender
        */
       static CRS fromWkt( const std::string &wkt );
 
+      /**
+       * Creates a CRS from a PROJ string.
+       * \param proj PROJ string for the desired spatial reference system.
+       * \returns matching CRS, or throw an exception InvalidCRSError if string could not be matched
+       * \throws InvalidCRSError
+       */
+      static CRS fromProj( const std::string &proj );
+
       /**
        * Returns a shared_ptr to the underlying QgsCoordinateReferenceSystem object.
        */
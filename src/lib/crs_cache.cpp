@@ -0,0 +1,153 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "crs_cache.h"
+#include "lru_cache.h"
+
+#include <qgscoordinatereferencesystem.h>
+#include <qgscoordinatetransform.h>
+#include <qgscoordinatetransformcontext.h>
+
+#include <QHash>
+#include <QPair>
+
+#include <mutex>
+
+namespace
+{
+  const std::size_t DEFAULT_CAPACITY = 1024;
+
+  struct QStringHash
+  {
+      std::size_t operator()( const QString &string ) const
+      {
+        return qHash( string );
+      }
+  };
+
+  typedef QPair<QString, QString> TransformKey;
+
+  struct TransformKeyHash
+  {
+      std::size_t operator()( const TransformKey &key ) const
+      {
+        return qHash( key );
+      }
+  };
+
+  typedef HeadlessRender::QgsCoordinateReferenceSystemPtr CrsPtr;
+  typedef HeadlessRender::LruCache<QString, CrsPtr, QStringHash> DefinitionCache;
+  typedef HeadlessRender::LruCache<TransformKey, QgsCoordinateTransform, TransformKeyHash>
+    TransformCache;
+
+  std::mutex cacheMutex;
+  DefinitionCache crsCache( DEFAULT_CAPACITY );
+  // CRSes by canonical definitions, so that equal CRSes share the same object
+  DefinitionCache canonicalCache( DEFAULT_CAPACITY );
+  TransformCache transformCache( DEFAULT_CAPACITY );
+
+  // Canonical definition of CRS, equal for CRSes created from different definitions
+  QString canonicalDefinition( const QgsCoordinateReferenceSystem &crs )
+  {
+#if _QGIS_VERSION_INT < 33600
+    return crs.toWkt( QgsCoordinateReferenceSystem::WKT_PREFERRED );
+#else
+    return crs.toWkt( Qgis::CrsWktVariant::Preferred );
+#endif
+  }
+} // namespace
+
+HeadlessRender::QgsCoordinateReferenceSystemPtr HeadlessRender::CrsCache::crs(
+  const QString &definition, const std::function<QgsCoordinateReferenceSystem()> &create
+)
+{
+  {
+    std::lock_guard<std::mutex> lock( cacheMutex );
+    if ( std::optional<CrsPtr> crs = crsCache.get( definition ) )
+      return *crs;
+  }
+
+  // CRS is created outside of the lock, as PROJ database lookups may be slow
+  const QgsCoordinateReferenceSystem created = create();
+  if ( !created.isValid() )
+    return nullptr;
+  const QString canonical = canonicalDefinition( created );
+
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  CrsPtr crs;
+  if ( std::optional<CrsPtr> equal = canonicalCache.get( canonical ) )
+    crs = *equal;
+  else
+  {
+    crs = std::make_shared<QgsCoordinateReferenceSystem>( created );
+    canonicalCache.put( canonical, crs );
+  }
+  crsCache.put( definition, crs );
+  return crs;
+}
+
+QgsCoordinateTransform HeadlessRender::CrsCache::transform(
+  const QgsCoordinateReferenceSystem &source, const QgsCoordinateReferenceSystem &destination
+)
+{
+  const TransformKey key( canonicalDefinition( source ), canonicalDefinition( destination ) );
+
+  {
+    std::lock_guard<std::mutex> lock( cacheMutex );
+    if ( std::optional<QgsCoordinateTransform> transform = transformCache.get( key ) )
+      return *transform;
+  }
+
+  const QgsCoordinateTransform transform( source, destination, QgsCoordinateTransformContext() );
+
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  transformCache.put( key, transform );
+  return transform;
+}
+
+void HeadlessRender::CrsCache::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  crsCache.setCapacity( capacity );
+  canonicalCache.setCapacity( capacity );
+  transformCache.setCapacity( capacity );
+}
+
+HeadlessRender::CacheStats HeadlessRender::CrsCache::stats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return crsCache.stats();
+}
+
+HeadlessRender::CacheStats HeadlessRender::CrsCache::transformStats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return transformCache.stats();
+}
+
+void HeadlessRender::CrsCache::clear()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  crsCache.clear();
+  crsCache.resetStats();
+  canonicalCache.clear();
+  transformCache.clear();
+  transformCache.resetStats();
+}
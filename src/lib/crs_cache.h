@@ -0,0 +1,83 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_CRS_CACHE_H
+#define QGIS_HEADLESS_CRS_CACHE_H
+
+#include <functional>
+#include <QString>
+#include "crs.h"
+#include "types.h"
+
+class QgsCoordinateTransform;
+
+namespace HeadlessRender
+{
+  /**
+   * Process-wide thread-safe caches of coordinate reference systems and transforms.
+   * CRSes are keyed by their definitions, and equal CRSes, created from different definitions,
+   * share the same object. Transforms are keyed by source and destination CRSes and use the
+   * default transform context.
+   */
+  class QGIS_HEADLESS_EXPORT CrsCache
+  {
+    public:
+      /**
+       * Returns CRS for the definition from the cache, creating it with \a create on miss.
+       * \returns nullptr, if created CRS is invalid, invalid CRSes are not cached.
+       */
+      static QgsCoordinateReferenceSystemPtr crs(
+        const QString &definition, const std::function<QgsCoordinateReferenceSystem()> &create
+      );
+
+      /**
+       * Returns transform between CRSes from the cache, creating it on miss.
+       */
+      static QgsCoordinateTransform transform(
+        const QgsCoordinateReferenceSystem &source, const QgsCoordinateReferenceSystem &destination
+      );
+
+      /**
+       * Sets maximum number of cached CRS definitions and transforms,
+       * least recently used entries are evicted.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns hit, miss and eviction counters of the cache of CRSes.
+       */
+      static CacheStats stats();
+
+      /**
+       * Returns hit, miss and eviction counters of the cache of transforms.
+       */
+      static CacheStats transformStats();
+
+      /**
+       * Removes all CRSes and transforms from the caches and resets statistics.
+       */
+      static void clear();
+
+    private:
+      CrsCache() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_CRS_CACHE_H
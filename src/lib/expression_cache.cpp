@@ -0,0 +1,331 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "expression_cache.h"
+#include "lru_cache.h"
+
+#include <qgsexpression.h>
+#include <qgsexpressioncontext.h>
+#include <qgsexpressionfunction.h>
+#include <qgsexpressionnodeimpl.h>
+#include <qgsfeature.h>
+#include <qgsfields.h>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace
+{
+  const std::size_t DEFAULT_CAPACITY = 100000;
+
+  const QString FUNCTION_NAME = QStringLiteral( "headless_memoize" );
+
+  // Functions, results of which depend on something besides feature's attributes
+  const QSet<QString> DYNAMIC_FUNCTIONS = {
+    QStringLiteral( "rand" ),
+    QStringLiteral( "randf" ),
+    QStringLiteral( "now" ),
+    QStringLiteral( "uuid" ),
+    QStringLiteral( "$uuid" ),
+    QStringLiteral( "var" ),
+    QStringLiteral( "eval" ),
+    QStringLiteral( "env" ),
+    QStringLiteral( "$scale" ),
+    QStringLiteral( "$page" ),
+    QStringLiteral( "$numpages" ),
+    QStringLiteral( "get_feature" ),
+    QStringLiteral( "get_feature_by_id" ),
+    QStringLiteral( "aggregate" ),
+    QStringLiteral( "relation_aggregate" ),
+    QStringLiteral( "layer_property" ),
+  };
+
+  // Maximum number of expressions, timings of which are collected
+  const int MAX_TIMINGS = 1024;
+
+  // Maximum number of expressions, prepared by a rendering thread
+  const std::size_t MAX_PREPARED_EXPRESSIONS = 256;
+
+  // Results don't depend on layers, but on names of their fields, values of attributes, referenced
+  // by expression, and on feature id, only if it is referenced too
+  struct ResultKey
+  {
+      QString expression;
+      QString fields;
+      QgsFeatureId featureId;
+      QgsAttributes attributes;
+
+      bool operator==( const ResultKey &other ) const
+      {
+        return featureId == other.featureId && expression == other.expression
+               && fields == other.fields && attributes == other.attributes;
+      }
+  };
+
+  struct ResultKeyHash
+  {
+      std::size_t operator()( const ResultKey &key ) const
+      {
+        std::size_t seed = qHash( key.expression ) ^ ( qHash( key.fields ) << 1 );
+        seed ^= std::hash<qint64>()( key.featureId ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        for ( const QVariant &value : key.attributes )
+          seed ^= qHash( value.toString() ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        return seed;
+      }
+  };
+
+  typedef HeadlessRender::LruCache<ResultKey, QVariant, ResultKeyHash> Cache;
+
+  std::mutex cacheMutex;
+  Cache cache( DEFAULT_CAPACITY );
+  QMap<QString, HeadlessRender::ExpressionTiming> timings;
+
+  // Incremented on clear(), so that threads drop their prepared expressions
+  std::atomic<int> generation( 0 );
+
+  // Expression prepared for fields of a layer
+  struct PreparedExpression
+  {
+      std::shared_ptr<QgsExpression> expression;
+      QList<int> attributeIndexes; // indexes of referenced attributes
+      bool usesFeatureId = false;
+  };
+
+  typedef QPair<QString, QString> PreparedKey; // expression and names of fields
+
+  struct PreparedKeyHash
+  {
+      std::size_t operator()( const PreparedKey &key ) const
+      {
+        return qHash( key.first ) ^ ( qHash( key.second ) << 1 );
+      }
+  };
+
+  struct PreparedExpressions
+  {
+      int generation = -1;
+      HeadlessRender::LruCache<PreparedKey, PreparedExpression, PreparedKeyHash> expressions {
+        MAX_PREPARED_EXPRESSIONS
+      };
+  };
+
+  thread_local PreparedExpressions preparedExpressions;
+
+  void addTiming( const QString &expression, bool hit, qint64 prepareTime, qint64 evaluateTime )
+  {
+    if ( timings.size() >= MAX_TIMINGS && !timings.contains( expression ) )
+      return;
+
+    HeadlessRender::ExpressionTiming &timing = timings[expression];
+    ++timing.evaluations;
+    if ( hit )
+      ++timing.hits;
+    timing.prepareTime += prepareTime / 1e9;
+    timing.evaluateTime += evaluateTime / 1e9;
+  }
+
+  // Names of fields, identifying layouts of attributes
+  QString fieldsKey( const QgsFields &fields )
+  {
+    return fields.names().join( QChar( 0x1f ) );
+  }
+
+  QString memoizedArgument( const QgsExpressionNodeFunction *node )
+  {
+    if ( !node || !node->args() || node->args()->count() != 1 )
+      return QString();
+
+    const QgsExpressionNode *arg = node->args()->at( 0 );
+    if ( arg->nodeType() != QgsExpressionNode::ntLiteral )
+      return QString();
+
+    return static_cast<const QgsExpressionNodeLiteral *>( arg )->value().toString();
+  }
+
+  // headless_memoize('expression') evaluates expression, given as a string literal, and caches
+  // the result by names of fields and values of referenced attributes
+  class MemoizeFunction : public QgsExpressionFunction
+  {
+    public:
+      MemoizeFunction()
+        : QgsExpressionFunction(
+            FUNCTION_NAME, QgsExpressionFunction::ParameterList()
+                             << QgsExpressionFunction::Parameter( QStringLiteral( "expression" ) ),
+            QStringLiteral( "Custom" )
+          )
+      {}
+
+      QVariant func(
+        const QVariantList &values, const QgsExpressionContext *context, QgsExpression *parent,
+        const QgsExpressionNodeFunction *
+      ) override
+      {
+        const QString expression = values.at( 0 ).toString();
+        if ( !context )
+          return QgsExpression( expression ).evaluate();
+
+        const QgsFeature feature = context->feature();
+        const QgsFields fields = context->fields().isEmpty() ? feature.fields()
+                                                             : context->fields();
+        const PreparedKey preparedKey( expression, fieldsKey( fields ) );
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if ( preparedExpressions.generation != generation )
+        {
+          preparedExpressions.expressions.clear();
+          preparedExpressions.generation = generation;
+        }
+
+        std::optional<PreparedExpression> prepared = preparedExpressions.expressions.get(
+          preparedKey
+        );
+        if ( !prepared )
+        {
+          prepared = PreparedExpression();
+          prepared->expression = std::make_shared<QgsExpression>( expression );
+          prepared->expression->prepare( context );
+          prepared->attributeIndexes = prepared->expression->referencedAttributeIndexes( fields )
+                                         .values();
+          std::sort( prepared->attributeIndexes.begin(), prepared->attributeIndexes.end() );
+          prepared->usesFeatureId = prepared->expression->referencedFunctions().contains(
+            QStringLiteral( "$id" )
+          );
+          preparedExpressions.expressions.put( preparedKey, *prepared );
+        }
+        const qint64 prepareTime = timer.nsecsElapsed();
+
+        const QgsAttributes featureAttributes = feature.attributes();
+        QgsAttributes attributes;
+        for ( const int index : prepared->attributeIndexes )
+          attributes.append( featureAttributes.value( index ) );
+        const ResultKey key {
+          expression, preparedKey.second, prepared->usesFeatureId ? feature.id() : FID_NULL,
+          attributes
+        };
+
+        {
+          std::lock_guard<std::mutex> lock( cacheMutex );
+          if ( std::optional<QVariant> result = cache.get( key ) )
+          {
+            addTiming( expression, true, 0, 0 );
+            return *result;
+          }
+        }
+
+        timer.restart();
+        const QVariant result = prepared->expression->evaluate( context );
+        const qint64 evaluateTime = timer.nsecsElapsed();
+
+        if ( prepared->expression->hasEvalError() )
+        {
+          parent->setEvalErrorString( prepared->expression->evalErrorString() );
+          return QVariant();
+        }
+
+        std::lock_guard<std::mutex> lock( cacheMutex );
+        cache.put( key, result );
+        addTiming( expression, false, prepareTime, evaluateTime );
+        return result;
+      }
+
+      bool usesGeometry( const QgsExpressionNodeFunction * ) const override
+      {
+        return false;
+      }
+
+      QSet<QString> referencedColumns( const QgsExpressionNodeFunction *node ) const override
+      {
+        return QgsExpression( memoizedArgument( node ) ).referencedColumns();
+      }
+
+      bool handlesNull() const override
+      {
+        return true;
+      }
+  };
+} // namespace
+
+void HeadlessRender::ExpressionCache::registerFunction()
+{
+  if ( !QgsExpression::isFunctionName( FUNCTION_NAME ) )
+    QgsExpression::registerFunction( new MemoizeFunction() );
+}
+
+QString HeadlessRender::ExpressionCache::memoizedExpression( const QString &expression )
+{
+  const QgsExpression qgsExpression( expression );
+  if ( qgsExpression.hasParserError() || qgsExpression.needsGeometry()
+       || !qgsExpression.referencedVariables().isEmpty() || qgsExpression.isField() )
+    return expression;
+
+  for ( const QString &function : qgsExpression.referencedFunctions() )
+  {
+    if ( function == FUNCTION_NAME || DYNAMIC_FUNCTIONS.contains( function ) )
+      return expression;
+  }
+
+  return QStringLiteral( "%1(%2)" )
+    .arg( FUNCTION_NAME, QgsExpression::quotedString( expression ) );
+}
+
+void HeadlessRender::ExpressionCache::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.setCapacity( capacity );
+}
+
+HeadlessRender::CacheStats HeadlessRender::ExpressionCache::stats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return cache.stats();
+}
+
+std::vector<HeadlessRender::ExpressionTiming> HeadlessRender::ExpressionCache::timings()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  std::vector<ExpressionTiming> result;
+  for ( auto it = ::timings.constBegin(); it != ::timings.constEnd(); ++it )
+  {
+    ExpressionTiming timing = it.value();
+    timing.expression = it.key().toStdString();
+    result.push_back( timing );
+  }
+  return result;
+}
+
+void HeadlessRender::ExpressionCache::clear()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.clear();
+  cache.resetStats();
+  ::timings.clear();
+  ++generation;
+}
@@ -0,0 +1,92 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_EXPRESSION_CACHE_H
+#define QGIS_HEADLESS_EXPRESSION_CACHE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <QString>
+#include "types.h"
+
+namespace HeadlessRender
+{
+  /**
+   * Evaluation statistics of a memoized expression.
+   */
+  struct ExpressionTiming
+  {
+      std::string expression;
+      std::size_t evaluations = 0; // number of evaluations, including memoized ones
+      std::size_t hits = 0;        // number of evaluations, served from the cache
+      double prepareTime = 0;      // total time of parsing and preparation, in seconds
+      double evaluateTime = 0;     // total time of evaluation on cache misses, in seconds
+  };
+
+  /**
+   * Process-wide thread-safe cache of expression results, keyed by expression, names of layer
+   * fields and values of referenced attributes, so results are shared between features, layers
+   * and requests. Feature id is a part of the key only for expressions, which use $id.
+   * Expressions are prepared once per layer fields and rendering thread, each thread keeps up to
+   * 256 least recently used prepared expressions. Only expressions wrapped with
+   * memoizedExpression() are cached, see Style::withMemoizedExpressions().
+   */
+  class QGIS_HEADLESS_EXPORT ExpressionCache
+  {
+    public:
+      /**
+       * Registers expression function, which evaluates memoized expressions. Called by init().
+       */
+      static void registerFunction();
+
+      /**
+       * Returns expression, which memoizes results of \a expression, or \a expression itself if it
+       * can't be memoized: it depends on geometry, variables or non-deterministic functions.
+       */
+      static QString memoizedExpression( const QString &expression );
+
+      /**
+       * Sets maximum number of cached results, least recently used results are evicted.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns hit, miss and eviction counters of the cache.
+       */
+      static CacheStats stats();
+
+      /**
+       * Returns evaluation statistics of memoized expressions. Statistics are collected for up to
+       * 1024 distinct expressions, until clear() is called.
+       */
+      static std::vector<ExpressionTiming> timings();
+
+      /**
+       * Removes all results and prepared expressions from the cache and resets statistics.
+       */
+      static void clear();
+
+    private:
+      ExpressionCache() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_EXPRESSION_CACHE_H
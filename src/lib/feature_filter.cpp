@@ -0,0 +1,122 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "feature_filter.h"
+#include <qgsexception.h>
+#include <qgsfeaturerequest.h>
+#include <qgsvectorlayer.h>
+
+void HeadlessRender::FeatureFilterProvider::setFilter( LayerIndex index, const FeatureFilter &filter )
+{
+  mFilters[index] = filter;
+}
+
+bool HeadlessRender::FeatureFilterProvider::hasFilter( LayerIndex index ) const
+{
+  return mFilters.contains( index );
+}
+
+void HeadlessRender::FeatureFilterProvider::bindLayer(
+  LayerIndex index, const QgsMapLayer *layer,
+  const QgsCoordinateTransform &extentTransform /* = QgsCoordinateTransform() */
+)
+{
+  const auto it = mFilters.constFind( index );
+  if ( it == mFilters.constEnd() )
+    return;
+
+  const QgsVectorLayer *vectorLayer = qobject_cast<const QgsVectorLayer *>( layer );
+  if ( !vectorLayer )
+    return;
+
+  FeatureFilter filter = it.value();
+  if ( !filter.extent.isNull() && extentTransform.isValid() )
+  {
+    try
+    {
+      filter.extent = extentTransform.transformBoundingBox( filter.extent );
+    }
+    catch ( const QgsCsException & )
+    {
+      // Features are still clipped by the map extent
+      filter.extent = QgsRectangle();
+    }
+  }
+
+  mBoundFilters[vectorLayer->id()] = filter;
+}
+
+void HeadlessRender::FeatureFilterProvider::clearBindings()
+{
+  mBoundFilters.clear();
+}
+
+QString HeadlessRender::FeatureFilterProvider::layerFilterExpression( const QgsVectorLayer * ) const
+{
+  return QString();
+}
+
+QStringList HeadlessRender::FeatureFilterProvider::
+  layerAttributes( const QgsVectorLayer *, const QStringList &attributes ) const
+{
+  // Renderers already fetch only attributes they use
+  return attributes;
+}
+
+#if _QGIS_VERSION_INT < 33600
+void HeadlessRender::FeatureFilterProvider::filterFeatures( const QgsVectorLayer *layer, QgsFeatureRequest &request ) const
+{
+  applyFilter( layer->id(), request );
+}
+#else
+void HeadlessRender::FeatureFilterProvider::filterFeatures( const QString &layerId, QgsFeatureRequest &request ) const
+{
+  applyFilter( layerId, request );
+}
+#endif
+
+QgsFeatureFilterProvider *HeadlessRender::FeatureFilterProvider::clone() const
+{
+  return new FeatureFilterProvider( *this );
+}
+
+void HeadlessRender::FeatureFilterProvider::applyFilter( const QString &layerId, QgsFeatureRequest &request ) const
+{
+  const auto it = mBoundFilters.constFind( layerId );
+  if ( it == mBoundFilters.constEnd() )
+    return;
+
+  const FeatureFilter &filter = it.value();
+
+  // Expression is compiled and passed to the provider by the feature iterator when possible
+  if ( !filter.expression.isEmpty() )
+    request.combineFilterExpression( filter.expression );
+
+  if ( !filter.extent.isNull() )
+  {
+    const QgsRectangle requestRect = request.filterRect();
+    const QgsRectangle rect = requestRect.isNull() ? filter.extent
+                                                   : requestRect.intersect( filter.extent );
+    if ( rect.isEmpty() )
+      request.setFilterFids( QgsFeatureIds() );
+    else
+      request.setFilterRect( rect );
+  }
+}
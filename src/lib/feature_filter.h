@@ -0,0 +1,88 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_FEATURE_FILTER_H
+#define QGIS_HEADLESS_FEATURE_FILTER_H
+
+#include <qgscoordinatetransform.h>
+#include <qgsfeaturefilterprovider.h>
+#include <qgsrectangle.h>
+#include <QHash>
+#include <QString>
+#include "types.h"
+
+namespace HeadlessRender
+{
+  /**
+   * Restrictions applied to features fetched for a layer of a single map request.
+   */
+  struct FeatureFilter
+  {
+      QString expression;  // empty if features are not filtered by expression
+      QgsRectangle extent; // null if features are not filtered by extent
+  };
+
+  /**
+   * Applies filters of map request's layers to feature requests of rendering jobs.
+   * Filters are set by layer index and bound to the ids of QGIS layers selected for rendering.
+   */
+  class FeatureFilterProvider : public QgsFeatureFilterProvider
+  {
+    public:
+      void setFilter( LayerIndex index, const FeatureFilter &filter );
+
+      /**
+       * Returns true, if filter is set for the layer index.
+       */
+      bool hasFilter( LayerIndex index ) const;
+
+      /**
+       * Binds filter of the layer index to the QGIS layer, which is going to be rendered.
+       * \param extentTransform transforms filter's extent into CRS of the QGIS layer, if it is a
+       * reprojected copy of the request's layer.
+       */
+      void bindLayer(
+        LayerIndex index, const QgsMapLayer *layer,
+        const QgsCoordinateTransform &extentTransform = QgsCoordinateTransform()
+      );
+
+      /**
+       * Removes all layer bindings, filters are kept.
+       */
+      void clearBindings();
+
+      QString layerFilterExpression( const QgsVectorLayer *layer ) const override;
+      QStringList layerAttributes( const QgsVectorLayer *layer, const QStringList &attributes ) const override;
+#if _QGIS_VERSION_INT < 33600
+      void filterFeatures( const QgsVectorLayer *layer, QgsFeatureRequest &request ) const override;
+#else
+      void filterFeatures( const QString &layerId, QgsFeatureRequest &request ) const override;
+#endif
+      QgsFeatureFilterProvider *clone() const override;
+
+    private:
+      void applyFilter( const QString &layerId, QgsFeatureRequest &request ) const;
+
+      QHash<LayerIndex, FeatureFilter> mFilters;
+      QHash<QString, FeatureFilter> mBoundFilters;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_FEATURE_FILTER_H
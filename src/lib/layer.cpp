@@ -20,15 +20,70 @@
 
 #include "layer.h"
 #include "crs.h"
+#include "crs_cache.h"
 #include "utils.h"
 #include "exceptions.h"
 #include "style.h"
+#include "raster_block_cache.h"
+#include "band_statistics_cache.h"
 #include <qgsvectorlayer.h>
 #include <qgsrasterlayer.h>
+#include <qgsrasterdataprovider.h>
+#include <qgsrasterblock.h>
 #include <qgsmemoryproviderutils.h>
 #include <qgssinglesymbolrenderer.h>
 #include <qgssymbol.h>
+#include <qgscoordinatereferencesystem.h>
+#include <qgscoordinatetransform.h>
+#include <qgsexception.h>
+#include <qgsmaplayerstyle.h>
 #include <QByteArray>
+#include <QRunnable>
+#include <QSet>
+#include <QThreadPool>
+
+#include <cpl_error.h>
+#include <cpl_vsi.h>
+#include <gdal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <functional>
+
+// Half of the EPSG:3857 world width
+constexpr double WebMercatorOrigin = 20037508.342789244;
+
+// Maximum zoom level of XYZ tiles, at which number of tiles along an axis still fits into int
+constexpr int MaxTileZoom = 30;
+
+// Maximum number of CRSes, reprojected copies of a layer are kept in
+constexpr int MaxReprojections = 4;
+
+// Dynamic property of QgsMapLayer, which holds generation of its style, see styleGeneration()
+const char *const StyleGenerationProperty = "headlessStyleGeneration";
+
+// Copies of layer and its detail levels, transformed into CRSes of maps
+struct HeadlessRender::Layer::Reprojections
+{
+    bool enabled = false;
+    // Style of the layer needs its own geometries or feature ids,
+    // see Style::needsSourceFeatures()
+    bool sourceFeatures = false;
+    // Incremented whenever copies are dropped or restyled, so that copies being built are
+    // discarded
+    int generation = 0;
+    std::mutex mutex;
+    // Destination CRSes and copies in them: the layer itself followed by its detail levels,
+    // from least to most recently used
+    QVector<QPair<QgsCoordinateReferenceSystem, QVector<QgsMapLayerPtr>>> copies;
+    // Destination CRSes, copies in which are being built
+    QVector<QgsCoordinateReferenceSystem> building;
+};
+
+std::atomic<quint64> lastStyleGeneration( 0 );
 
 void disableVectorSimplify( const std::shared_ptr<QgsVectorLayer> &qgsVectorLayer )
 {
@@ -43,8 +98,275 @@ void disableVectorSimplify( const std::shared_ptr<QgsVectorLayer> &qgsVectorLaye
   qgsVectorLayer->setSimplifyMethod( simplifyMethod );
 }
 
+// Creates a memory layer with features and spatial index, ids assigned by provider are set to features
+std::shared_ptr<QgsVectorLayer> createMemoryLayer(
+  const QgsFields &fields, Qgis::WkbType wkbType, const QgsCoordinateReferenceSystem &crs,
+  QgsFeatureList &features
+)
+{
+  std::shared_ptr<QgsVectorLayer> qgsLayer(
+    QgsMemoryProviderUtils::createMemoryLayer( "layername", fields, wkbType, crs )
+  );
+  disableVectorSimplify( qgsLayer );
+
+  qgsLayer->dataProvider()->addFeatures( features, QgsFeatureSink::FastInsert );
+  qgsLayer->dataProvider()->createSpatialIndex();
+
+  return qgsLayer;
+}
+
+// Creates a memory copy of vector layer with geometries transformed into another CRS, features
+// which can't be transformed are skipped
+HeadlessRender::QgsMapLayerPtr reprojectLayer(
+  const HeadlessRender::QgsMapLayerPtr &layer, const QgsCoordinateReferenceSystem &destinationCrs
+)
+{
+  QgsVectorLayer *qgsVectorLayer = static_cast<QgsVectorLayer *>( layer.get() );
+  const QgsCoordinateTransform transform = HeadlessRender::CrsCache::transform(
+    qgsVectorLayer->crs(), destinationCrs
+  );
+
+  QgsFeatureList features;
+  QgsFeatureIterator it = qgsVectorLayer->getFeatures();
+  QgsFeature feature;
+  while ( it.nextFeature( feature ) )
+  {
+    QgsGeometry geometry = feature.geometry();
+    if ( !geometry.isNull() && transform.isValid() )
+    {
+      try
+      {
+        geometry.transform( transform );
+      }
+      catch ( const QgsCsException & )
+      {
+        continue;
+      }
+      feature.setGeometry( geometry );
+    }
+    features.push_back( feature );
+  }
+
+  std::shared_ptr<QgsVectorLayer> copy = createMemoryLayer(
+    qgsVectorLayer->fields(), qgsVectorLayer->wkbType(), destinationCrs, features
+  );
+  copy->setName( qgsVectorLayer->name() );
+
+  // Style of the layer, including the current one of its style manager
+  QgsMapLayerStyle style;
+  style.readFromLayer( qgsVectorLayer );
+  style.writeToLayer( copy.get() );
+
+  return copy;
+}
+
+QgsFeature createFeature( const QgsFields &fields, const HeadlessRender::Layer::FeatureData &data )
+{
+  QgsFeature feature( fields, data.id );
+
+  QgsGeometry geom;
+  geom.fromWkb( QByteArray::fromStdString( data.wkb ) );
+
+  feature.setAttributes( QgsAttributes( data.attributes ) );
+  feature.setGeometry( geom );
+
+  return feature;
+}
+
+QgsGeometry generalizeGeometry( const QgsGeometry &geometry, double tolerance )
+{
+  const QgsGeometry generalized = geometry.simplify( tolerance );
+  // Features collapsed by generalization are kept as they are, so they are still visible
+  if ( generalized.isNull() || generalized.isEmpty() )
+    return geometry;
+  return generalized;
+}
+
+/**
+ * Accumulates bounding box of changed geometries.
+ */
+class ChangedExtent
+{
+  public:
+    void add( const QgsGeometry &geometry )
+    {
+      if ( geometry.isNull() || geometry.isEmpty() )
+        return;
+
+      if ( mChanged )
+        mRect.combineExtentWith( geometry.boundingBox() );
+      else
+        mRect = geometry.boundingBox();
+      mChanged = true;
+    }
+
+    std::optional<HeadlessRender::Extent> extent() const
+    {
+      if ( !mChanged )
+        return std::nullopt;
+      return HeadlessRender::Extent( mRect.xMinimum(), mRect.yMinimum(), mRect.xMaximum(), mRect.yMaximum() );
+    }
+
+  private:
+    QgsRectangle mRect;
+    bool mChanged = false;
+};
+
+void setRendererSymbolColor( QgsVectorLayer *layer, const QColor &color )
+{
+  QgsSingleSymbolRenderer *singleRenderer = dynamic_cast< QgsSingleSymbolRenderer * >(
+    layer->renderer()
+  );
+  std::unique_ptr<QgsSymbol> newSymbol;
+
+  if ( singleRenderer && singleRenderer->symbol() )
+    newSymbol.reset( singleRenderer->symbol()->clone() );
+
+  const QgsSingleSymbolRenderer *embeddedRenderer = nullptr;
+  if ( !newSymbol && layer->renderer()->embeddedRenderer() )
+  {
+    embeddedRenderer = dynamic_cast< const QgsSingleSymbolRenderer * >(
+      layer->renderer()->embeddedRenderer()
+    );
+    if ( embeddedRenderer && embeddedRenderer->symbol() )
+      newSymbol.reset( embeddedRenderer->symbol()->clone() );
+  }
+
+  if ( newSymbol )
+  {
+    newSymbol->setColor( color );
+    if ( singleRenderer )
+    {
+      singleRenderer->setSymbol( newSymbol.release() );
+    }
+    else if ( embeddedRenderer )
+    {
+      std::unique_ptr<QgsSingleSymbolRenderer> newRenderer( embeddedRenderer->clone() );
+      newRenderer->setSymbol( newSymbol.release() );
+      layer->renderer()->setEmbeddedRenderer( newRenderer.release() );
+    }
+  }
+}
+
+// Builds overviews with a separate GDAL dataset, opened read-only for external overviews
+void buildGdalOverviews(
+  const QString &source, const std::vector<int> &levels, const std::string &resampling,
+  bool external
+)
+{
+  for ( const int level : levels )
+  {
+    if ( level < 2 )
+      throw QgisHeadlessError( QStringLiteral( "Invalid overview level: %1" ).arg( level ) );
+  }
+
+  CPLErrorReset();
+  GDALDatasetH dataset = GDALOpenEx(
+    source.toUtf8().constData(), GDAL_OF_RASTER | ( external ? GDAL_OF_READONLY : GDAL_OF_UPDATE ),
+    nullptr, nullptr, nullptr
+  );
+  if ( !dataset )
+    throw HeadlessRender::InvalidLayerSource(
+      QStringLiteral( "Unable to open data source: " ) + QString::fromUtf8( CPLGetLastErrorMsg() )
+    );
+
+  std::vector<int> overviewList = levels;
+  const CPLErr result = GDALBuildOverviews(
+    dataset, resampling.c_str(), static_cast<int>( overviewList.size() ), overviewList.data(), 0,
+    nullptr, nullptr, nullptr
+  );
+  const QString error = QString::fromUtf8( CPLGetLastErrorMsg() );
+  GDALClose( dataset );
+
+  if ( result != CE_None )
+    throw QgisHeadlessError( QStringLiteral( "Unable to build overviews: " ) + error );
+}
+
+// Builds overviews in a thread of overviewThreadPool(), errors are passed to the future
+class BuildOverviewsTask : public QRunnable
+{
+  public:
+    explicit BuildOverviewsTask( std::function<void()> build )
+      : mTask( std::move( build ) )
+    {}
+
+    std::shared_future<void> future()
+    {
+      return mTask.get_future().share();
+    }
+
+    void run() override
+    {
+      mTask();
+    }
+
+  private:
+    std::packaged_task<void()> mTask;
+};
+
+// Threads of background builds are tracked, so that deinit() waits for them
+QThreadPool &overviewThreadPool()
+{
+  static QThreadPool threadPool;
+  return threadPool;
+}
+
+// Registers buffer as a /vsimem/ file, the extension is derived from driver's metadata, since
+// drivers are identified by file extension
+QString registerVsimemBuffer( const char *data, std::size_t size, const std::string &driverHint )
+{
+  static std::atomic<quint64> counter( 0 );
+
+  QString extension;
+  if ( !driverHint.empty() )
+  {
+    GDALDriverH driver = GDALGetDriverByName( driverHint.c_str() );
+    if ( !driver )
+      throw HeadlessRender::InvalidLayerSource(
+        QStringLiteral( "Unknown driver: " ) + QString::fromStdString( driverHint )
+      );
+
+    const QString extensions = QString::fromUtf8(
+      GDALGetMetadataItem( driver, GDAL_DMD_EXTENSIONS, nullptr )
+    );
+    if ( !extensions.isEmpty() )
+      extension = "." + extensions.section( ' ', 0, 0 );
+  }
+
+  const QString path = QStringLiteral( "/vsimem/qgis_headless/%1%2" ).arg( counter++ ).arg( extension );
+
+  VSILFILE *file = VSIFileFromMemBuffer(
+    path.toUtf8().constData(), reinterpret_cast<GByte *>( const_cast<char *>( data ) ),
+    static_cast<vsi_l_offset>( size ), FALSE
+  );
+  if ( !file )
+    throw HeadlessRender::InvalidLayerSource( "Unable to register in-memory data source" );
+  VSIFCloseL( file );
+
+  return path;
+}
+
+// Wraps layer so the /vsimem/ file is unlinked and the buffer is released after the layer is deleted
+HeadlessRender::QgsMapLayerPtr attachVsimemBuffer(
+  const HeadlessRender::QgsMapLayerPtr &layer, const QString &path,
+  const HeadlessRender::BufferOwner &owner
+)
+{
+  return HeadlessRender::QgsMapLayerPtr(
+    layer.get(), [layer, path, owner]( QgsMapLayer * ) mutable {
+      layer.reset();
+      VSIUnlink( path.toUtf8().constData() );
+      owner.reset();
+    }
+  );
+}
+
 HeadlessRender::Layer::Layer( const HeadlessRender::QgsMapLayerPtr &qgsMapLayer )
   : mLayer( qgsMapLayer )
+  , mDetailLevels( std::make_shared<DetailLevels>() )
+  , mFeatureIds( std::make_shared<FeatureIds>() )
+  , mReprojections( std::make_shared<Reprojections>() )
+  , mDirtyExtents( std::make_shared<std::vector<Extent>>() )
 {}
 
 HeadlessRender::Layer HeadlessRender::Layer::fromOgr( const std::string &uri )
@@ -70,39 +392,580 @@ HeadlessRender::Layer HeadlessRender::Layer::fromGdal( const std::string &uri )
       + qgsRasterLayer->error().message( QgsErrorMessage::Text )
     );
 
+  RasterBlockCache::install( qgsRasterLayer.get() );
+
+  // Statistics computed by the default contrast enhancement are kept for later layers and styles
+  BandStatisticsCache::restore( qgsRasterLayer->dataProvider() );
+  BandStatisticsCache::store( qgsRasterLayer->dataProvider() );
   return Layer( qgsRasterLayer );
 }
 
+HeadlessRender::Layer HeadlessRender::Layer::fromOgrBuffer(
+  const char *data, std::size_t size, const std::string &driverHint, const BufferOwner &owner
+)
+{
+  const QString path = registerVsimemBuffer( data, size, driverHint );
+  try
+  {
+    Layer layer = fromOgr( path.toStdString() );
+    layer.mLayer = attachVsimemBuffer( layer.mLayer, path, owner );
+    return layer;
+  }
+  catch ( ... )
+  {
+    VSIUnlink( path.toUtf8().constData() );
+    throw;
+  }
+}
+
+HeadlessRender::Layer HeadlessRender::Layer::fromGdalBuffer(
+  const char *data, std::size_t size, const std::string &driverHint, const BufferOwner &owner
+)
+{
+  const QString path = registerVsimemBuffer( data, size, driverHint );
+  try
+  {
+    Layer layer = fromGdal( path.toStdString() );
+    layer.mLayer = attachVsimemBuffer( layer.mLayer, path, owner );
+    return layer;
+  }
+  catch ( ... )
+  {
+    VSIUnlink( path.toUtf8().constData() );
+    throw;
+  }
+}
+
 HeadlessRender::Layer HeadlessRender::Layer::fromData(
   HeadlessRender::LayerGeometryType geometryType, const CRS &crs,
   const QVector<QPair<QString, HeadlessRender::LayerAttributeType>> &attributeTypes,
-  const QVector<HeadlessRender::Layer::FeatureData> &featureDataList
+  const QVector<HeadlessRender::Layer::FeatureData> &featureDataList,
+  const QVector<double> &detailTolerances /* = {} */
 )
 {
   QgsFields fields;
   for ( const QPair<QString, HeadlessRender::LayerAttributeType> &attrType : attributeTypes )
     fields.append( QgsField( attrType.first, layerAttributeTypetoQVariantType( attrType.second ) ) );
 
-  std::shared_ptr<QgsVectorLayer> qgsLayer(
-    QgsMemoryProviderUtils::
-      createMemoryLayer( "layername", fields, layerGeometryTypeToQgsWkbType( geometryType ), *crs.qgsCoordinateReferenceSystem() )
-  );
-  disableVectorSimplify( qgsLayer );
+  const Qgis::WkbType wkbType = layerGeometryTypeToQgsWkbType( geometryType );
 
+  QgsFeatureList features;
+  features.reserve( featureDataList.size() );
   for ( const auto &data : featureDataList )
+    features.push_back( createFeature( fields, data ) );
+
+  const QgsCoordinateReferenceSystem &qgsCrs = *crs.qgsCoordinateReferenceSystem();
+  Layer layer( createMemoryLayer( fields, wkbType, qgsCrs, features ) );
+
+  for ( int i = 0; i < featureDataList.size(); ++i )
+    layer.mFeatureIds->insert( featureDataList[i].id, features[i].id() );
+
+  // Generalizing points makes no sense, so detail levels are built for lines and polygons only
+  if ( QgsWkbTypes::geometryType( wkbType ) == Qgis::GeometryType::Line
+       || QgsWkbTypes::geometryType( wkbType ) == Qgis::GeometryType::Polygon )
+  {
+    QVector<double> tolerances = detailTolerances;
+    std::sort( tolerances.begin(), tolerances.end() );
+
+    for ( const double tolerance : tolerances )
+    {
+      if ( tolerance <= 0 )
+        continue;
+
+      QgsFeatureList generalizedFeatures = features;
+      for ( QgsFeature &feature : generalizedFeatures )
+        feature.setGeometry( generalizeGeometry( feature.geometry(), tolerance ) );
+
+      DetailLevel level {
+        tolerance, createMemoryLayer( fields, wkbType, qgsCrs, generalizedFeatures ), {}
+      };
+      for ( int i = 0; i < featureDataList.size(); ++i )
+        level.featureIds.insert( featureDataList[i].id, generalizedFeatures[i].id() );
+      layer.mDetailLevels->push_back( level );
+    }
+  }
+
+  return layer;
+}
+
+std::optional<HeadlessRender::Extent> HeadlessRender::Layer::addFeatures(
+  const QVector<FeatureData> &featureDataList
+)
+{
+  QgsVectorLayer *qgsVectorLayer = memoryLayer();
+  const QgsFields fields = qgsVectorLayer->fields();
+
+  QgsFeatureList features;
+  QSet<qint64> ids;
+  ChangedExtent changed;
+  for ( const FeatureData &data : featureDataList )
+  {
+    if ( mFeatureIds->contains( data.id ) || ids.contains( data.id ) )
+      throw QgisHeadlessError( QStringLiteral( "Feature already exists: %1" ).arg( data.id ) );
+    ids.insert( data.id );
+
+    features.push_back( createFeature( fields, data ) );
+    changed.add( features.back().geometry() );
+  }
+
+  // Ids are assigned by providers, so they are mapped for each detail level separately
+  for ( DetailLevel &level : *mDetailLevels )
+  {
+    QgsFeatureList generalizedFeatures = features;
+    for ( QgsFeature &feature : generalizedFeatures )
+      feature.setGeometry( generalizeGeometry( feature.geometry(), level.tolerance ) );
+
+    QgsVectorLayer *levelLayer = static_cast<QgsVectorLayer *>( level.layer.get() );
+    levelLayer->dataProvider()->addFeatures( generalizedFeatures, QgsFeatureSink::FastInsert );
+    levelLayer->updateExtents();
+
+    for ( int i = 0; i < featureDataList.size(); ++i )
+      level.featureIds.insert( featureDataList[i].id, generalizedFeatures[i].id() );
+  }
+
+  qgsVectorLayer->dataProvider()->addFeatures( features, QgsFeatureSink::FastInsert );
+  qgsVectorLayer->updateExtents();
+
+  for ( int i = 0; i < featureDataList.size(); ++i )
+    mFeatureIds->insert( featureDataList[i].id, features[i].id() );
+
+  clearReprojections();
+
+  return markDirty( changed.extent() );
+}
+
+std::optional<HeadlessRender::Extent> HeadlessRender::Layer::updateFeatures(
+  const QVector<FeatureData> &featureDataList
+)
+{
+  QgsVectorLayer *qgsVectorLayer = memoryLayer();
+  const QgsFields fields = qgsVectorLayer->fields();
+
+  QVector<QgsFeature> features;
+  ChangedExtent changed;
+  for ( const FeatureData &data : featureDataList )
   {
-    QgsFeature feature( fields, data.id );
+    const auto it = mFeatureIds->constFind( data.id );
+    if ( it == mFeatureIds->constEnd() )
+      throw QgisHeadlessError( QStringLiteral( "Feature not found: %1" ).arg( data.id ) );
+
+    features.push_back( createFeature( fields, data ) );
+    changed.add( qgsVectorLayer->getFeature( it.value() ).geometry() );
+    changed.add( features.back().geometry() );
+  }
 
-    QgsGeometry geom;
-    geom.fromWkb( QByteArray::fromStdString( data.wkb ) );
+  // Changes of features, mapped to feature ids of the layer or its detail level
+  const auto changeFeatures = [&]( QgsVectorLayer *layer, const FeatureIds &featureIds,
+                                   double tolerance ) {
+    QgsGeometryMap geometries;
+    QgsChangedAttributesMap attributes;
+    for ( int i = 0; i < featureDataList.size(); ++i )
+    {
+      const QgsFeatureId id = featureIds.value( featureDataList[i].id );
+      geometries.insert(
+        id, tolerance > 0 ? generalizeGeometry( features[i].geometry(), tolerance )
+                          : features[i].geometry()
+      );
+
+      QgsAttributeMap attributeMap;
+      for ( int j = 0; j < featureDataList[i].attributes.size(); ++j )
+        attributeMap.insert( j, featureDataList[i].attributes[j] );
+      attributes.insert( id, attributeMap );
+    }
 
-    feature.setAttributes( QgsAttributes( data.attributes ) );
-    feature.setGeometry( geom );
+    layer->dataProvider()->changeFeatures( attributes, geometries );
+    layer->updateExtents();
+  };
 
-    qgsLayer->dataProvider()->addFeature( feature, QgsFeatureSink::FastInsert );
+  for ( const DetailLevel &level : *mDetailLevels )
+  {
+    QgsVectorLayer *levelLayer = static_cast<QgsVectorLayer *>( level.layer.get() );
+    changeFeatures( levelLayer, level.featureIds, level.tolerance );
   }
+  changeFeatures( qgsVectorLayer, *mFeatureIds, 0 );
+
+  clearReprojections();
 
-  return Layer( qgsLayer );
+  return markDirty( changed.extent() );
+}
+
+std::optional<HeadlessRender::Extent> HeadlessRender::Layer::deleteFeatures( const QVector<qint64> &ids )
+{
+  QgsVectorLayer *qgsVectorLayer = memoryLayer();
+
+  QgsFeatureIds featureIds;
+  ChangedExtent changed;
+  for ( const qint64 id : ids )
+  {
+    const auto it = mFeatureIds->constFind( id );
+    if ( it == mFeatureIds->constEnd() )
+      throw QgisHeadlessError( QStringLiteral( "Feature not found: %1" ).arg( id ) );
+
+    featureIds.insert( it.value() );
+    changed.add( qgsVectorLayer->getFeature( it.value() ).geometry() );
+  }
+
+  for ( const DetailLevel &level : *mDetailLevels )
+  {
+    QgsFeatureIds levelFeatureIds;
+    for ( const qint64 id : ids )
+      levelFeatureIds.insert( level.featureIds.value( id ) );
+
+    QgsVectorLayer *levelLayer = static_cast<QgsVectorLayer *>( level.layer.get() );
+    levelLayer->dataProvider()->deleteFeatures( levelFeatureIds );
+    levelLayer->updateExtents();
+  }
+
+  qgsVectorLayer->dataProvider()->deleteFeatures( featureIds );
+  qgsVectorLayer->updateExtents();
+
+  for ( const qint64 id : ids )
+  {
+    mFeatureIds->remove( id );
+    for ( DetailLevel &level : *mDetailLevels )
+      level.featureIds.remove( id );
+  }
+
+  clearReprojections();
+
+  return markDirty( changed.extent() );
+}
+
+std::vector<HeadlessRender::Extent> HeadlessRender::Layer::dirtyExtents() const
+{
+  return *mDirtyExtents;
+}
+
+void HeadlessRender::Layer::clearDirtyExtents()
+{
+  mDirtyExtents->clear();
+}
+
+std::vector<HeadlessRender::TileRange> HeadlessRender::Layer::dirtyTiles(
+  const Style &style, int minZoom, int maxZoom, int tileSize /* = 256 */, int dpi /* = 96 */,
+  int maxLabelLength /* = 64 */
+) const
+{
+  if ( minZoom < 0 || maxZoom > MaxTileZoom || minZoom > maxZoom )
+    throw QgisHeadlessError(
+      QStringLiteral( "Invalid zoom range: %1-%2, zoom levels must be from 0 to %3" )
+        .arg( minZoom )
+        .arg( maxZoom )
+        .arg( MaxTileZoom )
+    );
+  if ( tileSize <= 0 )
+    throw QgisHeadlessError( QStringLiteral( "Invalid tile size: %1" ).arg( tileSize ) );
+
+  std::vector<TileRange> result;
+  if ( mDirtyExtents->empty() )
+    return result;
+
+  QVector<QgsRectangle> rects;
+  const QgsCoordinateTransform transform = CrsCache::transform(
+    mLayer->crs(), QgsCoordinateReferenceSystem( QStringLiteral( "EPSG:3857" ) )
+  );
+  for ( const Extent &extent : *mDirtyExtents )
+  {
+    const QgsRectangle rect(
+      std::get<0>( extent ), std::get<1>( extent ), std::get<2>( extent ), std::get<3>( extent )
+    );
+    try
+    {
+      rects.append( transform.isValid() ? transform.transformBoundingBox( rect ) : rect );
+    }
+    catch ( const QgsCsException & )
+    {
+      // Invalidate everything, if the change can't be located
+      rects.append( QgsRectangle( -WebMercatorOrigin, -WebMercatorOrigin, WebMercatorOrigin, WebMercatorOrigin ) );
+    }
+  }
+
+  const double bleed = style.maxBleed( dpi, maxLabelLength );
+
+  for ( int zoom = minZoom; zoom <= maxZoom; ++zoom )
+  {
+    const int tileCount = 1 << zoom;
+    const double tileSpan = 2 * WebMercatorOrigin / tileCount;
+    const double margin = bleed * tileSpan / tileSize;
+
+    auto tileIndex = [tileCount]( double value ) {
+      return std::clamp( static_cast<int>( std::floor( value ) ), 0, tileCount - 1 );
+    };
+
+    QVector<TileRange> ranges;
+    for ( const QgsRectangle &rect : rects )
+    {
+      ranges.append( TileRange(
+        zoom, tileIndex( ( rect.xMinimum() - margin + WebMercatorOrigin ) / tileSpan ),
+        tileIndex( ( WebMercatorOrigin - rect.yMaximum() - margin ) / tileSpan ),
+        tileIndex( ( rect.xMaximum() + margin + WebMercatorOrigin ) / tileSpan ),
+        tileIndex( ( WebMercatorOrigin - rect.yMinimum() + margin ) / tileSpan )
+      ) );
+    }
+
+    // Overlapping ranges are merged into their bounding range
+    for ( int i = 0; i < ranges.size(); ++i )
+    {
+      for ( int j = i + 1; j < ranges.size(); )
+      {
+        TileRange &a = ranges[i];
+        const TileRange &b = ranges[j];
+        if ( std::get<1>( a ) <= std::get<3>( b ) && std::get<1>( b ) <= std::get<3>( a )
+             && std::get<2>( a ) <= std::get<4>( b ) && std::get<2>( b ) <= std::get<4>( a ) )
+        {
+          a = TileRange(
+            zoom, std::min( std::get<1>( a ), std::get<1>( b ) ),
+            std::min( std::get<2>( a ), std::get<2>( b ) ),
+            std::max( std::get<3>( a ), std::get<3>( b ) ),
+            std::max( std::get<4>( a ), std::get<4>( b ) )
+          );
+          ranges.remove( j );
+          j = i + 1;
+        }
+        else
+          ++j;
+      }
+    }
+
+    result.insert( result.end(), ranges.begin(), ranges.end() );
+  }
+
+  return result;
+}
+
+std::optional<HeadlessRender::Extent> HeadlessRender::Layer::markDirty(
+  const std::optional<Extent> &extent
+)
+{
+  if ( extent )
+    mDirtyExtents->push_back( *extent );
+  return extent;
+}
+
+void HeadlessRender::Layer::setReprojectionCache( bool enabled )
+{
+  std::lock_guard<std::mutex> lock( mReprojections->mutex );
+  mReprojections->enabled = enabled;
+  if ( !enabled )
+  {
+    mReprojections->copies.clear();
+    ++mReprojections->generation;
+  }
+}
+
+bool HeadlessRender::Layer::reprojectionCache() const
+{
+  std::lock_guard<std::mutex> lock( mReprojections->mutex );
+  return mReprojections->enabled;
+}
+
+void HeadlessRender::Layer::clearReprojections()
+{
+  std::lock_guard<std::mutex> lock( mReprojections->mutex );
+  mReprojections->copies.clear();
+  ++mReprojections->generation;
+}
+
+QVector<QPair<QString, HeadlessRender::LayerAttributeType>> HeadlessRender::Layer::attributeTypes() const
+{
+  QVector<QPair<QString, LayerAttributeType>> attributeTypes;
+
+  const QgsVectorLayer *qgsVectorLayer = qobject_cast<const QgsVectorLayer *>( mLayer.get() );
+  if ( !qgsVectorLayer )
+    return attributeTypes;
+
+  for ( const QgsField &field : qgsVectorLayer->fields() )
+    attributeTypes.append( qMakePair( field.name(), qVariantTypeToLayerAttributeType( field.type() ) ) );
+
+  return attributeTypes;
+}
+
+void HeadlessRender::Layer::buildOverviews(
+  const std::vector<int> &levels, const std::string &resampling /* = "AVERAGE" */,
+  bool external /* = false */
+)
+{
+  buildGdalOverviews( gdalSource(), levels, resampling, external );
+  reload();
+}
+
+HeadlessRender::OverviewBuild HeadlessRender::Layer::buildOverviewsInBackground(
+  const std::vector<int> &levels, const std::string &resampling /* = "AVERAGE" */
+) const
+{
+  const QString source = gdalSource();
+
+  auto *task = new BuildOverviewsTask( [source, levels, resampling]() {
+    buildGdalOverviews( source, levels, resampling, true );
+  } );
+  const OverviewBuild build( task->future() );
+  overviewThreadPool().start( task );
+  return build;
+}
+
+void HeadlessRender::Layer::waitForOverviewBuilds()
+{
+  overviewThreadPool().waitForDone();
+}
+
+std::vector<std::pair<int, int>> HeadlessRender::Layer::overviewInfo() const
+{
+  std::vector<std::pair<int, int>> overviews;
+
+  // A new dataset sees overviews, built after the layer was opened
+  GDALDatasetH dataset = GDALOpenEx(
+    gdalSource().toUtf8().constData(), GDAL_OF_RASTER | GDAL_OF_READONLY, nullptr, nullptr, nullptr
+  );
+  if ( !dataset )
+    return overviews;
+
+  if ( GDALGetRasterCount( dataset ) > 0 )
+  {
+    GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+    for ( int i = 0; i < GDALGetOverviewCount( band ); ++i )
+    {
+      GDALRasterBandH overview = GDALGetOverview( band, i );
+      overviews.emplace_back( GDALGetRasterBandXSize( overview ), GDALGetRasterBandYSize( overview ) );
+    }
+  }
+
+  GDALClose( dataset );
+  return overviews;
+}
+
+void HeadlessRender::Layer::reload()
+{
+  const QString source = gdalSource();
+  mLayer->reload();
+  RasterBlockCache::invalidate( source );
+  BandStatisticsCache::invalidate( source );
+}
+
+HeadlessRender::OverviewBuild::OverviewBuild( const std::shared_future<void> &future )
+  : mFuture( future )
+{}
+
+void HeadlessRender::OverviewBuild::wait() const
+{
+  mFuture.get();
+}
+
+bool HeadlessRender::OverviewBuild::done() const
+{
+  return mFuture.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+}
+
+std::vector<double> HeadlessRender::Layer::sampleRaster(
+  const std::vector<std::pair<double, double>> &points, int band /* = 1 */
+) const
+{
+  const std::unique_ptr<QgsRasterDataProvider> provider( rasterProvider( band ) );
+  const QString source = provider->dataSourceUri();
+  const QgsRectangle sourceExtent = provider->extent();
+  const double pixelX = sourceExtent.width() / provider->xSize();
+  const double pixelY = sourceExtent.height() / provider->ySize();
+
+  std::vector<double> values;
+  values.reserve( points.size() );
+  for ( const std::pair<double, double> &point : points )
+  {
+    // A single pixel of native resolution centered at the point is the pixel under the point
+    const QgsRectangle extent(
+      point.first - pixelX / 2, point.second - pixelY / 2, point.first + pixelX / 2,
+      point.second + pixelY / 2
+    );
+    const std::unique_ptr<QgsRasterBlock> block(
+      RasterBlockCache::read( provider.get(), source, band, extent, 1, 1 )
+    );
+    if ( !block || !block->isValid() || block->isNoData( 0, 0 ) )
+      values.push_back( std::numeric_limits<double>::quiet_NaN() );
+    else
+      values.push_back( block->value( 0, 0 ) );
+  }
+
+  return values;
+}
+
+std::vector<double> HeadlessRender::Layer::readWindow(
+  const Extent &extent, const std::pair<int, int> &size, int band /* = 1 */
+) const
+{
+  const int width = size.first;
+  const int height = size.second;
+  if ( width <= 0 || height <= 0 )
+    throw QgisHeadlessError(
+      QStringLiteral( "Invalid size of window: %1x%2" ).arg( width ).arg( height )
+    );
+
+  const QgsRectangle rect(
+    std::get<0>( extent ), std::get<1>( extent ), std::get<2>( extent ), std::get<3>( extent )
+  );
+  if ( rect.isEmpty() )
+    throw QgisHeadlessError( QStringLiteral( "Extent of window is empty" ) );
+
+  const std::unique_ptr<QgsRasterDataProvider> provider( rasterProvider( band ) );
+  const std::unique_ptr<QgsRasterBlock> block( RasterBlockCache::read(
+    provider.get(), provider->dataSourceUri(), band, rect, width, height
+  ) );
+  if ( !block || !block->isValid() || block->width() != width || block->height() != height )
+    throw QgisHeadlessError( QStringLiteral( "Failed to read window of raster layer" ) );
+
+  std::vector<double> values( static_cast<std::size_t>( width ) * height );
+  for ( int j = 0; j < height; ++j )
+  {
+    for ( int i = 0; i < width; ++i )
+    {
+      const std::size_t index = static_cast<std::size_t>( j ) * width + i;
+      values[index] = block->isNoData( j, i ) ? std::numeric_limits<double>::quiet_NaN()
+                                              : block->value( j, i );
+    }
+  }
+
+  return values;
+}
+
+QgsRasterDataProvider *HeadlessRender::Layer::rasterProvider( int band ) const
+{
+  const QgsRasterLayer *qgsRasterLayer = qobject_cast<const QgsRasterLayer *>( mLayer.get() );
+  if ( !qgsRasterLayer || !qgsRasterLayer->dataProvider() )
+    throw QgisHeadlessError( QStringLiteral( "Layer is not a raster layer" ) );
+
+  const QgsRasterDataProvider *provider = qgsRasterLayer->dataProvider();
+  if ( band < 1 || band > provider->bandCount() )
+    throw QgisHeadlessError(
+      QStringLiteral( "Raster layer has no band %1, number of bands is %2" )
+        .arg( band )
+        .arg( provider->bandCount() )
+    );
+  if ( provider->xSize() <= 0 || provider->ySize() <= 0 )
+    throw QgisHeadlessError( QStringLiteral( "Raster layer has no known size in pixels" ) );
+
+  // Like rendering jobs, read a copy, so that the layer's provider is never read concurrently
+  QgsRasterDataProvider *copy = provider->clone();
+  if ( !copy )
+    throw QgisHeadlessError( QStringLiteral( "Failed to copy data provider of raster layer" ) );
+  return copy;
+}
+
+QString HeadlessRender::Layer::gdalSource() const
+{
+  const QgsRasterLayer *qgsRasterLayer = qobject_cast<const QgsRasterLayer *>( mLayer.get() );
+  if ( !qgsRasterLayer || !qgsRasterLayer->dataProvider()
+       || qgsRasterLayer->providerType() != QLatin1String( "gdal" ) )
+    throw QgisHeadlessError( QStringLiteral( "Layer is not a GDAL raster layer" ) );
+
+  const QString source = qgsRasterLayer->dataProvider()->dataSourceUri();
+  if ( source.startsWith( QLatin1String( "/vsimem/" ) ) )
+    throw QgisHeadlessError( QStringLiteral( "Overviews of in-memory layers are not supported" ) );
+  return source;
+}
+
+QgsVectorLayer *HeadlessRender::Layer::memoryLayer() const
+{
+  QgsVectorLayer *qgsVectorLayer = qobject_cast<QgsVectorLayer *>( mLayer.get() );
+  if ( !qgsVectorLayer || qgsVectorLayer->providerType() != QLatin1String( "memory" ) )
+    throw QgisHeadlessError( QStringLiteral( "Layer is not an in-memory layer" ) );
+  return qgsVectorLayer;
 }
 
 HeadlessRender::QgsMapLayerPtr HeadlessRender::Layer::qgsMapLayer() const
@@ -110,6 +973,76 @@ HeadlessRender::QgsMapLayerPtr HeadlessRender::Layer::qgsMapLayer() const
   return mLayer;
 }
 
+HeadlessRender::QgsMapLayerPtr HeadlessRender::Layer::qgsMapLayer( double mapUnitsPerPixel ) const
+{
+  QgsMapLayerPtr layer = mLayer;
+  for ( const DetailLevel &level : *mDetailLevels )
+  {
+    if ( level.tolerance > mapUnitsPerPixel )
+      break;
+    layer = level.layer;
+  }
+  return layer;
+}
+
+HeadlessRender::QgsMapLayerPtr HeadlessRender::Layer::qgsMapLayer(
+  double mapUnitsPerPixel, const QgsCoordinateReferenceSystem &destinationCrs
+) const
+{
+  const QgsMapLayerPtr layer = qgsMapLayer( mapUnitsPerPixel );
+  if ( type() != DataType::Vector || !destinationCrs.isValid() || mLayer->crs() == destinationCrs )
+    return layer;
+
+  int level = 0;
+  for ( int i = 0; i < mDetailLevels->size(); ++i )
+  {
+    if ( mDetailLevels->at( i ).layer == layer )
+      level = i + 1;
+  }
+
+  int generation = 0;
+  {
+    std::lock_guard<std::mutex> lock( mReprojections->mutex );
+    if ( !mReprojections->enabled || mReprojections->sourceFeatures )
+      return layer;
+
+    for ( int i = 0; i < mReprojections->copies.size(); ++i )
+    {
+      if ( mReprojections->copies.at( i ).first == destinationCrs )
+      {
+        mReprojections->copies.move( i, mReprojections->copies.size() - 1 );
+        return mReprojections->copies.last().second.at( level );
+      }
+    }
+
+    // Another request builds copies, meanwhile geometries are transformed while rendering
+    if ( mReprojections->building.contains( destinationCrs ) )
+      return layer;
+
+    mReprojections->building.push_back( destinationCrs );
+    generation = mReprojections->generation;
+  }
+
+  // Copies are built without the lock, so that requests in other CRSes aren't blocked
+  QVector<QgsMapLayerPtr> copies;
+  copies.push_back( reprojectLayer( mLayer, destinationCrs ) );
+  for ( const DetailLevel &detailLevel : *mDetailLevels )
+    copies.push_back( reprojectLayer( detailLevel.layer, destinationCrs ) );
+
+  std::lock_guard<std::mutex> lock( mReprojections->mutex );
+  mReprojections->building.removeAll( destinationCrs );
+
+  // Features or style were changed meanwhile
+  if ( generation != mReprojections->generation || !mReprojections->enabled )
+    return layer;
+
+  mReprojections->copies.push_back( qMakePair( destinationCrs, copies ) );
+  if ( mReprojections->copies.size() > MaxReprojections )
+    mReprojections->copies.removeFirst();
+
+  return copies.at( level );
+}
+
 HeadlessRender::DataType HeadlessRender::Layer::type() const
 {
   if ( mLayer && mLayer->isValid() )
@@ -127,44 +1060,52 @@ void HeadlessRender::Layer::setRendererSymbolColor( const QColor &color )
   if ( !layer )
     return;
 
-  QgsSingleSymbolRenderer *singleRenderer = dynamic_cast< QgsSingleSymbolRenderer * >(
-    layer->renderer()
-  );
-  std::unique_ptr<QgsSymbol> newSymbol;
+  ::setRendererSymbolColor( layer.get(), color );
+  mLayer->setProperty( StyleGenerationProperty, ++lastStyleGeneration );
 
-  if ( singleRenderer && singleRenderer->symbol() )
-    newSymbol.reset( singleRenderer->symbol()->clone() );
+  for ( const DetailLevel &level : *mDetailLevels )
+    ::setRendererSymbolColor( static_cast<QgsVectorLayer *>( level.layer.get() ), color );
 
-  const QgsSingleSymbolRenderer *embeddedRenderer = nullptr;
-  if ( !newSymbol && layer->renderer()->embeddedRenderer() )
+  std::lock_guard<std::mutex> lock( mReprojections->mutex );
+  ++mReprojections->generation;
+  for ( const auto &copies : mReprojections->copies )
   {
-    embeddedRenderer = dynamic_cast< const QgsSingleSymbolRenderer * >(
-      layer->renderer()->embeddedRenderer()
-    );
-    if ( embeddedRenderer && embeddedRenderer->symbol() )
-      newSymbol.reset( embeddedRenderer->symbol()->clone() );
+    for ( const QgsMapLayerPtr &copy : copies.second )
+      ::setRendererSymbolColor( static_cast<QgsVectorLayer *>( copy.get() ), color );
+  }
+}
+
+bool HeadlessRender::Layer::addStyle( HeadlessRender::Style &style, QString &error )
+{
+  if ( type() != style.type() )
+    throw StyleTypeMismatch( "Layer type and style type do not match" );
+
+  if ( !style.importToLayer( mLayer, error ) )
+    return false;
+  mLayer->setProperty( StyleGenerationProperty, ++lastStyleGeneration );
+
+  for ( DetailLevel &level : *mDetailLevels )
+  {
+    if ( !style.importToLayer( level.layer, error ) )
+      return false;
   }
 
-  if ( newSymbol )
+  std::lock_guard<std::mutex> lock( mReprojections->mutex );
+  mReprojections->sourceFeatures = style.needsSourceFeatures();
+  ++mReprojections->generation;
+  for ( auto &copies : mReprojections->copies )
   {
-    newSymbol->setColor( color );
-    if ( singleRenderer )
+    for ( QgsMapLayerPtr &copy : copies.second )
     {
-      singleRenderer->setSymbol( newSymbol.release() );
-    }
-    else if ( embeddedRenderer )
-    {
-      std::unique_ptr<QgsSingleSymbolRenderer> newRenderer( embeddedRenderer->clone() );
-      newRenderer->setSymbol( newSymbol.release() );
-      layer->renderer()->setEmbeddedRenderer( newRenderer.release() );
+      if ( !style.importToLayer( copy, error ) )
+        return false;
     }
   }
+
+  return true;
 }
 
-bool HeadlessRender::Layer::addStyle( HeadlessRender::Style &style, QString &error )
+quint64 HeadlessRender::Layer::styleGeneration() const
 {
-  if ( type() != style.type() )
-    throw StyleTypeMismatch( "Layer type and style type do not match" );
-
-  return style.importToLayer( mLayer, error );
+  return mLayer->property( StyleGenerationProperty ).toULongLong();
 }
@@ -21,20 +21,55 @@
 #ifndef QGIS_HEADLESS_LAYER_H
 #define QGIS_HEADLESS_LAYER_H
 
+#include <future>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
+#include <QHash>
 #include <QVariant>
 #include <QString>
 #include <QVector>
 #include "crs.h"
 #include "types.h"
 
+class QgsCoordinateReferenceSystem;
 class QgsMapLayer;
+class QgsRasterDataProvider;
+class QgsVectorLayer;
 
 namespace HeadlessRender
 {
   class Style;
   typedef std::shared_ptr<QgsMapLayer> QgsMapLayerPtr;
 
+  /**
+   * Keeps memory of an in-memory data source alive, released after the layer is destroyed.
+   */
+  typedef std::shared_ptr<void> BufferOwner;
+
+  /**
+   * Overviews of a raster layer, being built in background by Layer::buildOverviewsInBackground().
+   */
+  class QGIS_HEADLESS_EXPORT OverviewBuild
+  {
+    public:
+      explicit OverviewBuild( const std::shared_future<void> &future );
+
+      /**
+       * Waits until overviews are built, rethrows the error of building, if any.
+       */
+      void wait() const;
+
+      /**
+       * Returns true, if building is finished, either successfully or with an error.
+       */
+      bool done() const;
+
+    private:
+      std::shared_future<void> mFuture;
+  };
+
   /**
    * Represents a map layer (supports both vector and raster layer types).
    */
@@ -65,25 +100,213 @@ namespace HeadlessRender
        */
       static Layer fromGdal( const std::string &uri );
 
+      /**
+       * Creates a vector layer from an in-memory data source, registered under /vsimem/ without
+       * copying. The buffer must stay unchanged while the layer exists.
+       * \param data pointer to the content of data source (e.g., GeoJSON document or GeoPackage).
+       * \param size size of the content in bytes.
+       * \param driverHint GDAL driver short name used to pick file extension, may be empty.
+       * \param owner owner of the buffer, released after the layer is destroyed.
+       * \returns vector layer, loaded from the buffer.
+       */
+      static Layer fromOgrBuffer(
+        const char *data, std::size_t size, const std::string &driverHint, const BufferOwner &owner
+      );
+
+      /**
+       * Creates a raster layer from an in-memory data source, registered under /vsimem/ without
+       * copying. The buffer must stay unchanged while the layer exists.
+       * \param data pointer to the content of data source (e.g., GeoTIFF).
+       * \param size size of the content in bytes.
+       * \param driverHint GDAL driver short name used to pick file extension, may be empty.
+       * \param owner owner of the buffer, released after the layer is destroyed.
+       * \returns raster layer, loaded from the buffer.
+       */
+      static Layer fromGdalBuffer(
+        const char *data, std::size_t size, const std::string &driverHint, const BufferOwner &owner
+      );
+
       /**
        * Creates a vector layer of given geometry type, CRS with attributes of given types from QVector of FeatureList
        * \param geometryType type of geometry for vector layer.
        * \param crs CRS of layer.
        * \param attributeTypes names and types of attributive data of layer.
        * \param featureDataList spatial and attributive data of layer's objects.
+       * \param detailTolerances simplification tolerances (in units of layer's CRS), for each of
+       * them a generalized copy of the geometries is built, to be rendered at coarser resolutions.
        * \returns new vector non-file related layer.
        */
       static Layer fromData(
         LayerGeometryType geometryType, const CRS &crs,
         const QVector<QPair<QString, LayerAttributeType>> &attributeTypes,
-        const QVector<FeatureData> &featureDataList
+        const QVector<FeatureData> &featureDataList, const QVector<double> &detailTolerances = {}
+      );
+
+      /**
+       * Adds features to the in-memory layer, created by fromData(), and to its detail levels.
+       * \param featureDataList spatial and attributive data of new objects, ids must be unique.
+       * \returns bounding box of added features in layer's CRS, or std::nullopt if nothing changed.
+       */
+      std::optional<Extent> addFeatures( const QVector<FeatureData> &featureDataList );
+
+      /**
+       * Replaces geometries and attributes of features of the in-memory layer, created by fromData().
+       * \param featureDataList new spatial and attributive data of existing objects.
+       * \returns bounding box of both old and new geometries in layer's CRS, or std::nullopt if
+       * nothing changed.
+       */
+      std::optional<Extent> updateFeatures( const QVector<FeatureData> &featureDataList );
+
+      /**
+       * Deletes features of the in-memory layer, created by fromData().
+       * \param ids ids of objects to delete.
+       * \returns bounding box of deleted features in layer's CRS, or std::nullopt if nothing changed.
+       */
+      std::optional<Extent> deleteFeatures( const QVector<qint64> &ids );
+
+      /**
+       * Returns bounding boxes of features, changed since the last clearDirtyExtents() call.
+       * \sa addFeatures(), updateFeatures(), deleteFeatures()
+       */
+      std::vector<Extent> dirtyExtents() const;
+
+      /**
+       * Forgets changes of features, e.g. after affected tiles were invalidated.
+       */
+      void clearDirtyExtents();
+
+      /**
+       * Returns ranges of XYZ tiles (EPSG:3857 grid), affected by changes of features, for each zoom
+       * level. Changed extents are expanded by maximum bleed of style's symbols and labels.
+       * \param style style used for rendering of the layer.
+       * \param minZoom minimal zoom level, from 0 to 30.
+       * \param maxZoom maximal zoom level, from 0 to 30.
+       * \param tileSize size of tile in pixels.
+       * \param dpi resolution of tiles.
+       * \param maxLabelLength maximum number of characters in labels' texts, see Style::maxBleed().
+       */
+      std::vector<TileRange> dirtyTiles(
+        const Style &style, int minZoom, int maxZoom, int tileSize = 256, int dpi = 96,
+        int maxLabelLength = 64
+      ) const;
+
+      /**
+       * Builds overviews of the GDAL raster layer, which are read instead of full resolution data
+       * at coarse resolutions, and reloads the layer to use them.
+       * \param levels decimation factors of overviews, e.g. {2, 4, 8}, empty list removes them.
+       * \param resampling GDAL resampling method, e.g. "NEAREST", "AVERAGE" or "CUBIC".
+       * \param external if true, overviews are written to an external .ovr file and the source
+       * is left unchanged, otherwise they are stored in the source, if its format supports that.
+       */
+      void buildOverviews(
+        const std::vector<int> &levels, const std::string &resampling = "AVERAGE",
+        bool external = false
       );
 
+      /**
+       * Builds overviews of the GDAL raster layer in an external .ovr file in a background thread.
+       * The layer keeps reading the source without them until reload() is called.
+       * \param levels decimation factors of overviews, e.g. {2, 4, 8}.
+       * \param resampling GDAL resampling method, e.g. "NEAREST", "AVERAGE" or "CUBIC".
+       * \returns build, which is done when overviews are built and rethrows errors.
+       * \sa waitForOverviewBuilds()
+       */
+      OverviewBuild buildOverviewsInBackground(
+        const std::vector<int> &levels, const std::string &resampling = "AVERAGE"
+      ) const;
+
+      /**
+       * Waits until all overviews, being built in background, are done. Called by deinit().
+       */
+      static void waitForOverviewBuilds();
+
+      /**
+       * Returns widths and heights of overviews of the GDAL raster layer's first band, from the
+       * finest to the coarsest, including ones not yet used by the layer.
+       */
+      std::vector<std::pair<int, int>> overviewInfo() const;
+
+      /**
+       * Reopens the data source of the GDAL raster layer, e.g. to use overviews built in
+       * background. Cached blocks and band statistics of the source are dropped.
+       */
+      void reload();
+
+      /**
+       * Returns values of raster layer's band at given points, taken from cached blocks of
+       * RasterBlockCache, if it's enabled. Values of points outside of the raster and of no data
+       * pixels are NaN.
+       * \param points coordinates of points in layer's CRS.
+       * \param band number of band, starting from 1.
+       */
+      std::vector<double> sampleRaster(
+        const std::vector<std::pair<double, double>> &points, int band = 1
+      ) const;
+
+      /**
+       * Reads window of raster layer's band, resampled by nearest neighbour, through cached blocks
+       * of RasterBlockCache, if it's enabled. No data pixels and ones outside of the raster are NaN.
+       * \param extent extent of window in layer's CRS.
+       * \param size width and height of window in pixels.
+       * \param band number of band, starting from 1.
+       * \returns values of pixels row by row, starting from the top left corner.
+       */
+      std::vector<double> readWindow(
+        const Extent &extent, const std::pair<int, int> &size, int band = 1
+      ) const;
+
+      /**
+       * Returns names and types of attributes of vector layer.
+       */
+      QVector<QPair<QString, LayerAttributeType>> attributeTypes() const;
+
       /**
        * Returns a shared_ptr to the underlying QgsMapLayer object.
        */
       QgsMapLayerPtr qgsMapLayer() const;
 
+      /**
+       * Returns a shared_ptr to the QgsMapLayer object to be rendered at given resolution: the most
+       * generalized detail level, which tolerance does not exceed the size of a pixel.
+       * \param mapUnitsPerPixel size of output pixel in units of layer's CRS.
+       * \sa fromData()
+       */
+      QgsMapLayerPtr qgsMapLayer( double mapUnitsPerPixel ) const;
+
+      /**
+       * Returns a shared_ptr to the QgsMapLayer object to be rendered at given resolution in given
+       * CRS. If the reprojection cache is enabled and CRSes differ, the detail level is taken from
+       * the copy of the layer, which geometries are already transformed into destination CRS.
+       * \param mapUnitsPerPixel size of output pixel in units of layer's CRS.
+       * \param destinationCrs CRS of the map, into which the layer is rendered.
+       * \sa setReprojectionCache()
+       */
+      QgsMapLayerPtr qgsMapLayer(
+        double mapUnitsPerPixel, const QgsCoordinateReferenceSystem &destinationCrs
+      ) const;
+
+      /**
+       * Enables or disables cache of vector layer's geometries, transformed into CRSes of maps.
+       * On the first rendering in a CRS, a copy of the layer and of its detail levels is built in
+       * memory, so that later renderings in that CRS skip the transformation. Renderings, which
+       * start while the copy is being built, transform geometries on the fly instead of waiting.
+       * Copies in up to 4 most recently used CRSes are kept. They are dropped, when features are
+       * changed or the cache is disabled. The cache is shared by all copies of the layer, e.g.
+       * ones returned by LayerPool.
+       *
+       * Copies store geometries in the map's CRS and have their own feature ids, so expressions
+       * like $area, $x, x(@geometry) or $id would be evaluated differently on them. Layers with
+       * styles, which use such expressions, are always rendered from the layer itself.
+       * \sa Style::needsSourceFeatures()
+       */
+      void setReprojectionCache( bool enabled );
+
+      /**
+       * Returns true, if the reprojection cache is enabled.
+       * \sa setReprojectionCache()
+       */
+      bool reprojectionCache() const;
+
       /**
        * Returns type of layer: raster or vector.
        */
@@ -103,10 +326,61 @@ namespace HeadlessRender
        */
       bool addStyle( Style &style, QString &error );
 
+      /**
+       * Returns generation of layer's style: a process-wide unique number, which changes whenever
+       * a style or a symbol color is applied to the layer, or 0 if none was applied.
+       */
+      quint64 styleGeneration() const;
+
     private:
+      // Maps ids of FeatureData to feature ids of memory provider, which assigns them by itself
+      typedef QHash<qint64, qint64> FeatureIds;
+
+      /**
+       * Generalized copy of layer, used for rendering at coarse resolutions.
+       */
+      struct DetailLevel
+      {
+          double tolerance;
+          QgsMapLayerPtr layer;
+          FeatureIds featureIds;
+      };
+
+      typedef QVector<DetailLevel> DetailLevels;
+
+      /**
+       * Copies of layer and its detail levels, transformed into CRSes of maps, defined in
+       * layer.cpp.
+       */
+      struct Reprojections;
+
       explicit Layer( const QgsMapLayerPtr &qgsMapLayer );
 
+      /**
+       * Returns the in-memory vector layer, throws if layer was not created by fromData().
+       */
+      QgsVectorLayer *memoryLayer() const;
+
+      /**
+       * Returns data source of the GDAL raster layer, throws if layer wasn't created by fromGdal().
+       */
+      QString gdalSource() const;
+
+      /**
+       * Returns new copy of raster layer's data provider for reading, throws if layer is not
+       * a raster layer or has no given band.
+       */
+      QgsRasterDataProvider *rasterProvider( int band ) const;
+
+      std::optional<Extent> markDirty( const std::optional<Extent> &extent );
+
+      void clearReprojections();
+
       QgsMapLayerPtr mLayer;
+      std::shared_ptr<DetailLevels> mDetailLevels;
+      std::shared_ptr<FeatureIds> mFeatureIds;
+      std::shared_ptr<Reprojections> mReprojections;
+      std::shared_ptr<std::vector<Extent>> mDirtyExtents;
       mutable DataType mType = DataType::Unknown;
 
       friend class Project;
@@ -0,0 +1,111 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "layer_pool.h"
+#include "lru_cache.h"
+#include "utils.h"
+#include <QString>
+
+#include <mutex>
+
+namespace
+{
+  const std::size_t DEFAULT_CAPACITY = 64;
+
+  struct PooledLayer
+  {
+      HeadlessRender::Layer layer;
+      HeadlessRender::SourceState state;
+  };
+
+  typedef HeadlessRender::LruCache<std::string, PooledLayer> Pool;
+
+  std::mutex poolMutex;
+  Pool pool( DEFAULT_CAPACITY );
+
+  // Appends open options in the form understood by both OGR and GDAL providers
+  std::string uriWithOptions( const std::string &uri, const HeadlessRender::OpenOptions &openOptions )
+  {
+    std::string result = uri;
+    for ( const auto &option : openOptions )
+      result += "|option:" + option.first + "=" + option.second;
+    return result;
+  }
+
+  template<typename Open>
+  HeadlessRender::Layer fromPool( const std::string &key, const std::string &uri, Open open )
+  {
+    const HeadlessRender::SourceState state = HeadlessRender::sourceState(
+      QString::fromStdString( uri )
+    );
+
+    {
+      std::lock_guard<std::mutex> lock( poolMutex );
+      // Layers of changed sources are counted as invalidations and misses, not hits
+      const std::optional<PooledLayer> pooled = pool.get(
+        key, [&state]( const PooledLayer &pooled ) { return pooled.state == state; }
+      );
+      if ( pooled )
+        return pooled->layer;
+    }
+
+    // Open outside of the lock, so slow sources do not block other requests
+    HeadlessRender::Layer layer = open( uri );
+
+    std::lock_guard<std::mutex> lock( poolMutex );
+    pool.put( key, PooledLayer { layer, state } );
+    return layer;
+  }
+} // namespace
+
+HeadlessRender::Layer HeadlessRender::LayerPool::fromOgr(
+  const std::string &uri, const OpenOptions &openOptions
+)
+{
+  const std::string source = uriWithOptions( uri, openOptions );
+  return fromPool( "ogr:" + source, source, &Layer::fromOgr );
+}
+
+HeadlessRender::Layer HeadlessRender::LayerPool::fromGdal(
+  const std::string &uri, const OpenOptions &openOptions
+)
+{
+  const std::string source = uriWithOptions( uri, openOptions );
+  return fromPool( "gdal:" + source, source, &Layer::fromGdal );
+}
+
+void HeadlessRender::LayerPool::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( poolMutex );
+  pool.setCapacity( capacity );
+}
+
+HeadlessRender::CacheStats HeadlessRender::LayerPool::stats()
+{
+  std::lock_guard<std::mutex> lock( poolMutex );
+  return pool.stats();
+}
+
+void HeadlessRender::LayerPool::clear()
+{
+  std::lock_guard<std::mutex> lock( poolMutex );
+  pool.clear();
+  pool.resetStats();
+}
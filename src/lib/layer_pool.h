@@ -0,0 +1,79 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_LAYER_POOL_H
+#define QGIS_HEADLESS_LAYER_POOL_H
+
+#include <string>
+#include <vector>
+#include "layer.h"
+#include "types.h"
+
+namespace HeadlessRender
+{
+  typedef std::vector<std::pair<std::string, std::string>> OpenOptions;
+
+  /**
+   * Process-wide thread-safe pool of layers opened from data sources.
+   * Layers are shared between requests, keyed by URI and open options, and reopened when
+   * modification time or size of the source file changes.
+   *
+   * \note Only the pool itself is thread-safe. MapRequest::addLayer() applies style, name and
+   * symbol color to the shared layer, so requests rendering the same pooled layer with different
+   * styles must not run concurrently.
+   */
+  class QGIS_HEADLESS_EXPORT LayerPool
+  {
+    public:
+      /**
+       * Returns a vector layer from the pool, opening it with Layer::fromOgr() on miss.
+       * \param uri points to a data source with vector layer.
+       * \param openOptions driver specific open options.
+       */
+      static Layer fromOgr( const std::string &uri, const OpenOptions &openOptions = OpenOptions() );
+
+      /**
+       * Returns a raster layer from the pool, opening it with Layer::fromGdal() on miss.
+       * \param uri points to a data source with raster layer.
+       * \param openOptions driver specific open options.
+       */
+      static Layer fromGdal( const std::string &uri, const OpenOptions &openOptions = OpenOptions() );
+
+      /**
+       * Sets maximum number of pooled layers, least recently used layers are evicted.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns hit, miss, eviction and invalidation counters of the pool.
+       */
+      static CacheStats stats();
+
+      /**
+       * Removes all layers from the pool and resets statistics.
+       */
+      static void clear();
+
+    private:
+      LayerPool() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_LAYER_POOL_H
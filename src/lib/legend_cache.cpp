@@ -0,0 +1,95 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "legend_cache.h"
+#include "lru_cache.h"
+
+#include <mutex>
+
+namespace
+{
+  const std::size_t DEFAULT_CAPACITY = 4096;
+
+  struct LegendCacheKeyHash
+  {
+      std::size_t operator()( const HeadlessRender::LegendCacheKey &key ) const
+      {
+        std::size_t seed = qHash( key.style );
+        seed ^= qHash( key.title ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        seed ^= qHash( key.state ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        seed ^= static_cast<std::size_t>( key.width ) << 8;
+        seed ^= static_cast<std::size_t>( key.height ) << 16;
+        seed ^= static_cast<std::size_t>( key.dpi ) << 24;
+        seed ^= static_cast<std::size_t>( key.count ) << 4;
+        return seed;
+      }
+  };
+
+  typedef std::vector<HeadlessRender::LegendSymbol> LegendSymbols;
+  typedef HeadlessRender::LegendCacheKey Key;
+  typedef HeadlessRender::LruCache<Key, LegendSymbols, LegendCacheKeyHash> Cache;
+
+  std::mutex cacheMutex;
+  Cache cache( DEFAULT_CAPACITY );
+} // namespace
+
+bool HeadlessRender::LegendCacheKey::operator==( const LegendCacheKey &other ) const
+{
+  return width == other.width && height == other.height && dpi == other.dpi
+         && count == other.count && style == other.style && title == other.title
+         && state == other.state;
+}
+
+std::vector<HeadlessRender::LegendSymbol> HeadlessRender::LegendCache::symbols(
+  const LegendCacheKey &key, const std::function<std::vector<LegendSymbol>()> &draw
+)
+{
+  {
+    std::lock_guard<std::mutex> lock( cacheMutex );
+    if ( std::optional<LegendSymbols> symbols = cache.get( key ) )
+      return *symbols;
+  }
+
+  // Symbols are drawn outside of the lock, so other requests are not blocked
+  const std::vector<LegendSymbol> symbols = draw();
+
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.put( key, symbols );
+  return symbols;
+}
+
+void HeadlessRender::LegendCache::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.setCapacity( capacity );
+}
+
+HeadlessRender::CacheStats HeadlessRender::LegendCache::stats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return cache.stats();
+}
+
+void HeadlessRender::LegendCache::clear()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.clear();
+  cache.resetStats();
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_LEGEND_CACHE_H
+#define QGIS_HEADLESS_LEGEND_CACHE_H
+
+#include <functional>
+#include <vector>
+#include <QString>
+#include "legend_symbol.h"
+#include "types.h"
+
+namespace HeadlessRender
+{
+  /**
+   * Parameters, legend symbols of a layer depend on.
+   */
+  struct LegendCacheKey
+  {
+      QString style; // identity of style and layer's geometry type or data source
+      QString title; // name of layer, used by single-symbol legends
+      QString state; // check states of layer's legend items
+      int width = 0;
+      int height = 0;
+      int dpi = 0;
+      int count = 0;
+
+      bool operator==( const LegendCacheKey &other ) const;
+  };
+
+  /**
+   * Process-wide thread-safe cache of legend symbols, keyed by style, size, DPI and count.
+   * Cached symbols share their icons, so the icons must not be modified.
+   */
+  class QGIS_HEADLESS_EXPORT LegendCache
+  {
+    public:
+      /**
+       * Returns legend symbols from the cache, drawing them with \a draw on miss.
+       */
+      static std::vector<LegendSymbol> symbols(
+        const LegendCacheKey &key, const std::function<std::vector<LegendSymbol>()> &draw
+      );
+
+      /**
+       * Sets maximum number of cached legends, least recently used legends are evicted.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns hit, miss and eviction counters of the cache.
+       */
+      static CacheStats stats();
+
+      /**
+       * Removes all legends from the cache and resets statistics.
+       */
+      static void clear();
+
+    private:
+      LegendCache() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_LEGEND_CACHE_H
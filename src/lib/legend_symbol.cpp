@@ -47,6 +47,11 @@ ImagePtr LegendSymbol::icon() const
   return mIcon;
 }
 
+void LegendSymbol::setIcon( const ImagePtr &icon )
+{
+  mIcon = icon;
+}
+
 QString LegendSymbol::title() const
 {
   return mTitle;
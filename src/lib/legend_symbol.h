@@ -57,6 +57,12 @@ namespace HeadlessRender
        */
       ImagePtr icon() const;
 
+      /**
+       * Sets icon of symbol.
+       * \sa icon()
+       */
+      void setIcon( const ImagePtr &icon );
+
       /**
        * Returns title of symbol.
        */
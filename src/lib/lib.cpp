@@ -41,13 +41,25 @@
 #include <qgssinglebandpseudocolorrenderer.h>
 #include <qgsrastershader.h>
 #include <qgscolorrampshader.h>
+#include <qgscoordinatetransform.h>
+#include <qgsexception.h>
+#include <qgsexpression.h>
+#include <qgswkbtypes.h>
 
 #include "exceptions.h"
+#include "feature_filter.h"
 
 #include <QApplication>
 #include <QSizeF>
 #include <QPrinter>
 #include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QBuffer>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <cmath>
 #include <cstdlib>
 
 namespace
@@ -58,6 +70,7 @@ namespace
   const auto SymbolRenderingNotAdjustableError = QStringLiteral( "Symbol rendering is not adjustable" );
   const auto InvalidSymbolIndexError = QStringLiteral( "Invalid symbol index" );
   const auto InvalidLayerIndexError = QStringLiteral( "Invalid layer index" );
+  const auto InvalidSymbolSizeError = QStringLiteral( "Invalid legend symbol size" );
 
   namespace KEYS
   {
@@ -118,6 +131,26 @@ namespace
     return expressionContext;
   }
 
+  /**
+   * Returns size of output pixel in units of layer's CRS, or 0 if it can't be determined
+   */
+  double layerUnitsPerPixel( const QgsMapSettings &mapSettings, const QgsMapLayer *layer )
+  {
+    if ( layer->crs() == mapSettings.destinationCrs() )
+      return mapSettings.mapUnitsPerPixel();
+
+    try
+    {
+      const QgsCoordinateTransform transform = HeadlessRender::CrsCache::transform( mapSettings.destinationCrs(), layer->crs() );
+      const QgsRectangle extent = transform.transformBoundingBox( mapSettings.visibleExtent() );
+      return extent.width() / mapSettings.outputSize().width();
+    }
+    catch ( const QgsCsException & )
+    {
+      return 0;
+    }
+  }
+
   QColor interpolateColors( const QColor &color1, const QColor &color2, qreal ratio )
   {
     qreal inverseRatio = 1.0 - ratio;
@@ -128,6 +161,18 @@ namespace
       color1.alpha() * inverseRatio + color2.alpha() * ratio
     );
   }
+
+  // Identity of legend of layer with style. Legends of vector layers depend on style and geometry
+  // type, while raster renderers may take statistics from the data source
+  QString legendStyle( const HeadlessRender::QgsMapLayerPtr &layer, const HeadlessRender::Style &style )
+  {
+    const QString identity = style.isDefaultStyle()
+                               ? QStringLiteral( "Default_" ) + style.defaultStyleColor().name( QColor::HexArgb )
+                               : style.name();
+    if ( auto *vectorLayer = qobject_cast<QgsVectorLayer *>( layer.get() ) )
+      return identity + ':' + QgsWkbTypes::displayString( vectorLayer->wkbType() );
+    return identity + ':' + layer->source();
+  }
 } // namespace
 
 void HeadlessRender::init( int argc, char **argv )
@@ -139,10 +184,20 @@ void HeadlessRender::init( int argc, char **argv )
 
   app = new QgsApplication( argc, argv, false, "", platform );
   QgsApplication::initQgis();
+  ExpressionCache::registerFunction();
 }
 
 void HeadlessRender::deinit()
 {
+  Layer::waitForOverviewBuilds();
+  LayerPool::clear();
+  StyleCache::clear();
+  SvgResolver::clear();
+  ExpressionCache::clear();
+  LegendCache::clear();
+  CrsCache::clear();
+  RasterBlockCache::clear();
+  BandStatisticsCache::clear();
   QgsApplication::exitQgis();
   delete app;
 }
@@ -181,6 +236,7 @@ int HeadlessRender::getQGISVersionInt()
 HeadlessRender::MapRequest::MapRequest()
   : mSettings( std::make_shared<QgsMapSettings>() )
   , mQgsLayerTree( std::make_shared<QgsLayerTree>() )
+  , mFeatureFilterProvider( std::make_shared<FeatureFilterProvider>() )
 {
   mSettings->setBackgroundColor( Qt::transparent );
   mSettings->setFlag( Qgis::MapSettingsFlag::RenderBlocking );
@@ -196,13 +252,34 @@ void HeadlessRender::MapRequest::setCrs( const HeadlessRender::CRS &crs )
   mSettings->setDestinationCrs( *crs.qgsCoordinateReferenceSystem() );
 }
 
-HeadlessRender::LayerIndex HeadlessRender::MapRequest::
-  addLayer( HeadlessRender::Layer &layer, Style &style, const std::string &label /* = "" */ )
+HeadlessRender::LayerIndex HeadlessRender::MapRequest::addLayer(
+  HeadlessRender::Layer &layer, Style &style, const std::string &label /* = "" */,
+  const std::string &filter /* = "" */, const std::optional<Extent> &filterExtent /* = std::nullopt */
+)
 {
   QgsMapLayerPtr qgsMapLayer = layer.qgsMapLayer();
   if ( !qgsMapLayer )
     throw QgisHeadlessError( QStringLiteral( "Layer is null" ) );
 
+  const QgsExpression filterExpression( QString::fromStdString( filter ) );
+  if ( !filter.empty() || filterExtent )
+  {
+    if ( layer.type() != DataType::Vector )
+      throw QgisHeadlessError( QStringLiteral( "Filter is supported for vector layers only" ) );
+    if ( filterExpression.hasParserError() )
+      throw QgisHeadlessError(
+        QStringLiteral( "Invalid filter expression: " ) + filterExpression.parserErrorString()
+      );
+  }
+
+  // Filters are bound to QGIS layers by their ids, so a layer added twice would share them
+  for ( LayerIndex index = 0; index < mLayers.size(); ++index )
+  {
+    if ( mLayers[index].qgsMapLayer() == qgsMapLayer
+         && ( !filter.empty() || filterExtent || mFeatureFilterProvider->hasFilter( index ) ) )
+      throw QgisHeadlessError( QStringLiteral( "Filtered layer can be added to request only once" ) );
+  }
+
   if ( style.isDefaultStyle() )
   {
     layer.setRendererSymbolColor( style.defaultStyleColor() );
@@ -216,17 +293,34 @@ HeadlessRender::LayerIndex HeadlessRender::MapRequest::
 
   qgsMapLayer->setName( QString::fromStdString( label ) );
 
-  mLayers.push_back( qgsMapLayer );
+  mLayers.push_back( layer );
+  mLegendStyles.push_back( legendStyle( qgsMapLayer, style ) );
 
   QList<QgsMapLayer *> qgsMapLayers;
-  for ( const QgsMapLayerPtr &layer : mLayers )
-    qgsMapLayers.push_back( layer.get() );
+  for ( const HeadlessRender::Layer &layer : mLayers )
+    qgsMapLayers.push_back( layer.qgsMapLayer().get() );
   mSettings->setLayers( qgsMapLayers );
 
   mQgsLayerTree->addLayer( qgsMapLayer.get() );
+  mLegendRenderer.reset();
+  mLegendModel.reset();
 
   const auto addedLayerIndex = qgsMapLayers.size() - 1;
 
+  if ( !filter.empty() || filterExtent )
+  {
+    FeatureFilter featureFilter;
+    if ( !filter.empty() )
+      featureFilter.expression = filterExpression.expression();
+    if ( filterExtent )
+      featureFilter.extent = QgsRectangle(
+        std::get<0>( *filterExtent ), std::get<1>( *filterExtent ), std::get<2>( *filterExtent ),
+        std::get<3>( *filterExtent )
+      );
+
+    mFeatureFilterProvider->setFilter( addedLayerIndex, featureFilter );
+  }
+
   if ( QgsVectorLayer *vlayer = qobject_cast<QgsVectorLayer *>( qgsMapLayer.get() ) )
   {
     if ( vlayer->renderer() )
@@ -249,11 +343,14 @@ HeadlessRender::LayerIndex HeadlessRender::MapRequest::
 void HeadlessRender::MapRequest::addProject( const Project &project )
 {
   for ( const HeadlessRender::Layer &layer : project.layers() )
-    mLayers.push_back( layer.qgsMapLayer() );
+  {
+    mLayers.push_back( layer );
+    mLegendStyles.push_back( QString() );
+  }
 
   QList<QgsMapLayer *> qgsMapLayers;
-  for ( const QgsMapLayerPtr &layer : mLayers )
-    qgsMapLayers.push_back( layer.get() );
+  for ( const HeadlessRender::Layer &layer : mLayers )
+    qgsMapLayers.push_back( layer.qgsMapLayer().get() );
   mSettings->setLayers( qgsMapLayers );
 }
 
@@ -278,8 +375,11 @@ HeadlessRender::ImagePtr HeadlessRender::MapRequest::
   applyRenderSymbols( symbols.empty() ? mDefaultRenderSymbols : symbols );
 
   QgsMapRendererCustomPainterJob job( *mSettings, &painter );
+  job.setFeatureFilterProvider( mFeatureFilterProvider.get() );
   job.renderSynchronously();
 
+  storeBandStatistics();
+
   return std::make_shared<HeadlessRender::Image>( img );
 }
 
@@ -288,8 +388,7 @@ HeadlessRender::ImagePtr HeadlessRender::MapRequest::renderLegend( const Size &s
   int width = std::get<0>( size );
   int height = std::get<1>( size );
 
-  QgsLayerTreeModel legendModel( mQgsLayerTree.get() );
-  QgsLegendRenderer legendRenderer( &legendModel, QgsLegendSettings() );
+  QgsLegendRenderer &legendRenderer = this->legendRenderer();
 
   int dpi = mSettings->outputDpi();
   qreal dpmm = dpi / 25.4;
@@ -297,7 +396,7 @@ HeadlessRender::ImagePtr HeadlessRender::MapRequest::renderLegend( const Size &s
 
   if ( !width || !height )
   {
-    QSizeF minSize = legendRenderer.minimumSize();
+    const QSizeF &minSize = mLegendMinimumSize;
     img = QImage( QSize( minSize.width() * dpmm, minSize.height() * dpmm ), QImage::Format_ARGB32_Premultiplied );
   }
   else
@@ -317,6 +416,27 @@ HeadlessRender::ImagePtr HeadlessRender::MapRequest::renderLegend( const Size &s
   return std::make_shared<HeadlessRender::Image>( img );
 }
 
+QgsLegendRenderer &HeadlessRender::MapRequest::legendRenderer()
+{
+  // Layers may be shared with other requests, which apply other styles to them, so generations
+  // of layers' styles are compared too. Renderers can't be compared by address, as a new renderer
+  // may be allocated at the address of a deleted one.
+  std::vector<quint64> styleGenerations;
+  for ( const HeadlessRender::Layer &layer : mLayers )
+    styleGenerations.push_back( layer.styleGeneration() );
+
+  if ( !mLegendRenderer || styleGenerations != mLegendStyleGenerations )
+  {
+    mLegendRenderer.reset();
+    mLegendModel = std::make_shared<QgsLayerTreeModel>( mQgsLayerTree.get() );
+    mLegendRenderer = std::make_shared<QgsLegendRenderer>( mLegendModel.get(), QgsLegendSettings() );
+    mLegendStyleGenerations = styleGenerations;
+    mLegendMinimumSize = mLegendRenderer->minimumSize();
+  }
+
+  return *mLegendRenderer;
+}
+
 void HeadlessRender::MapRequest::exportPdf(
   const std::string &filepath, const Extent &extent, const HeadlessRender::Size &size
 )
@@ -343,19 +463,120 @@ void HeadlessRender::MapRequest::exportPdf(
   QPainter painter( &printer );
 
   QgsMapRendererCustomPainterJob job( *mSettings, &painter );
+  job.setFeatureFilterProvider( mFeatureFilterProvider.get() );
   job.prepare();
   job.renderPrepared();
 
   painter.end();
+
+  storeBandStatistics();
 }
 
+// Legend nodes, drawing of which is deferred, with positions of their symbols in the result
+typedef std::vector<std::pair<std::size_t, QgsLayerTreeModelLegendNode *>> DeferredLegendNodes;
+
+namespace
+{
+  // Legend nodes are drawn in parallel, only if there are at least this many nodes per thread
+  constexpr std::size_t MinLegendNodesPerThread = 16;
+
+  // Draws a range of legend nodes with its own image and painter
+  class LegendDrawTask : public QRunnable
+  {
+    public:
+      LegendDrawTask(
+        const DeferredLegendNodes &nodes, std::size_t begin, std::size_t end,
+        const QgsLegendSettings &settings, const QSize &size, int dpi, const QPointF &origin,
+        std::vector<HeadlessRender::LegendSymbol> &result
+      )
+        : mNodes( nodes )
+        , mBegin( begin )
+        , mEnd( end )
+        , mSettings( settings )
+        , mSize( size )
+        , mDpi( dpi )
+        , mOrigin( origin )
+        , mResult( result )
+      {}
+
+      void run() override
+      {
+        QImage image( mSize, QImage::Format_ARGB32_Premultiplied );
+
+        QPainter painter( &image );
+        QgsRenderContext context = QgsRenderContext::fromQPainter( &painter );
+        context.setFlag( Qgis::RenderContextFlag::Antialiasing, true );
+
+        const qreal dpmm = mDpi / 25.4;
+        context.painter()->scale( dpmm, dpmm );
+
+        QgsLayerTreeModelLegendNode::ItemContext ctx;
+        ctx.context = &context;
+        ctx.painter = context.painter();
+        ctx.columnLeft = mOrigin.x();
+        ctx.top = mOrigin.y();
+
+        for ( std::size_t i = mBegin; i < mEnd; ++i )
+        {
+          image.fill( Qt::transparent );
+#if _QGIS_VERSION_INT < 34405
+          mNodes[i].second->draw( mSettings, &ctx );
+#else
+          mNodes[i].second->draw( mSettings, ctx );
+#endif
+          mResult[mNodes[i].first].setIcon( std::make_shared<HeadlessRender::Image>( image ) );
+        }
+      }
+
+    private:
+      const DeferredLegendNodes &mNodes;
+      const std::size_t mBegin;
+      const std::size_t mEnd;
+      const QgsLegendSettings &mSettings;
+      const QSize mSize;
+      const int mDpi;
+      const QPointF mOrigin;
+      std::vector<HeadlessRender::LegendSymbol> &mResult;
+  };
+
+  /**
+   * Draws deferred legend nodes, splitting them between threads when there are many of them.
+   * Each symbol gets the icon of its node, so the order of symbols doesn't depend on threads.
+   */
+  void drawLegendNodes(
+    const DeferredLegendNodes &nodes, const QgsLegendSettings &settings, const QSize &size,
+    int dpi, const QPointF &origin, std::vector<HeadlessRender::LegendSymbol> &result
+  )
+  {
+    const std::size_t threads = std::min<std::size_t>(
+      std::max( 1, QThread::idealThreadCount() ), nodes.size() / MinLegendNodesPerThread
+    );
+    if ( threads <= 1 )
+    {
+      LegendDrawTask( nodes, 0, nodes.size(), settings, size, dpi, origin, result ).run();
+      return;
+    }
+
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount( static_cast<int>( threads ) );
+    const std::size_t chunk = ( nodes.size() + threads - 1 ) / threads;
+    for ( std::size_t begin = 0; begin < nodes.size(); begin += chunk )
+    {
+      const std::size_t end = std::min( begin + chunk, nodes.size() );
+      threadPool.start( new LegendDrawTask( nodes, begin, end, settings, size, dpi, origin, result ) );
+    }
+    threadPool.waitForDone();
+  }
+} // namespace
+
 static void processLegendGroup(
   const QList<QgsLayerTreeNode *> &group, std::vector<HeadlessRender::LegendSymbol> &result,
   QgsLayerTreeModel &model, const QgsLegendSettings &settings,
   QgsLayerTreeModelLegendNode::ItemContext &context, QImage &image,
   HeadlessRender::LegendSymbol::Index index = 0, QgsRasterRenderer *rasterRenderer = nullptr,
   QgsFeatureRenderer *featureRenderer = nullptr,
-  const int count = HeadlessRender::DefaultRasterRenderSymbolCount
+  const int count = HeadlessRender::DefaultRasterRenderSymbolCount,
+  DeferredLegendNodes *deferredNodes = nullptr
 )
 {
   auto createLegendSymbol = [&](
@@ -375,15 +596,23 @@ static void processLegendGroup(
                        ? HeadlessRender::SymbolRender::Checked
                        : HeadlessRender::SymbolRender::Unchecked;
 
-    image.fill( Qt::transparent );
+    // Symbols of vector layers may be drawn later, see drawLegendNodes()
+    HeadlessRender::ImagePtr icon;
+    if ( deferredNodes && featureRenderer )
+      deferredNodes->emplace_back( result.size(), node );
+    else
+    {
+      image.fill( Qt::transparent );
 #if _QGIS_VERSION_INT < 34405
-    node->draw( settings, &context );
+      node->draw( settings, &context );
 #else
-    node->draw( settings, context );
+      node->draw( settings, context );
 #endif
+      icon = std::make_shared<HeadlessRender::Image>( image );
+    }
 
     auto legendSymbol = HeadlessRender::LegendSymbol::
-      create( std::make_shared<HeadlessRender::Image>( image ), title, symbolRender, index++, rasterBand, hasTitle );
+      create( icon, title, symbolRender, index++, rasterBand, hasTitle );
     if ( nodes.size() == 1 && result.empty() )
       legendSymbol.setHasCategory( false );
     result.push_back( legendSymbol );
@@ -515,64 +744,264 @@ static void processLegendGroup(
     else
     {
       const auto group = QgsLayerTree::toGroup( it );
-      processLegendGroup( group->children(), result, model, settings, context, image, index, rasterRenderer, featureRenderer );
+      processLegendGroup( group->children(), result, model, settings, context, image, index, rasterRenderer, featureRenderer, count, deferredNodes );
     }
   }
 }
 
-std::vector<HeadlessRender::LegendSymbol> HeadlessRender::MapRequest::
-  legendSymbols( const LayerIndex index, const HeadlessRender::Size &size /* = Size() */, const int count /* = InvalidValue */ )
+namespace
 {
-  if ( mLayers.size() <= index )
-    throw QgisHeadlessError( InvalidLayerIndexError );
+  /**
+   * Legend of a layer: symbols with icons of raster layers, and legend nodes of vector layers,
+   * drawing of which is deferred, so that they can be drawn into their own icons or into a sprite.
+   */
+  class LayerLegend
+  {
+    public:
+      LayerLegend(
+        const HeadlessRender::QgsMapLayerPtr &layer, const int width, const int height,
+        const int count, const int dpi
+      )
+      {
+        QgsRasterRenderer *rasterRenderer = nullptr;
+        QgsFeatureRenderer *featureRenderer = nullptr;
+        if ( auto *rasterLayer = qobject_cast<QgsRasterLayer *>( layer.get() ) )
+          rasterRenderer = rasterLayer->renderer();
+        else
+          featureRenderer = qobject_cast<QgsVectorLayer *>( layer.get() )->renderer();
 
-  int width = std::get<0>( size );
-  int height = std::get<1>( size );
+        mTree.addLayer( layer.get() );
+        mModel = std::make_unique<QgsLayerTreeModel>( &mTree );
 
-  QgsMapLayerPtr layer = mLayers.at( index );
-  QgsRasterRenderer *rasterRenderer = nullptr;
-  QgsFeatureRenderer *featureRenderer = nullptr;
-  if ( auto *rasterLayer = qobject_cast<QgsRasterLayer *>( layer.get() ) )
-    rasterRenderer = rasterLayer->renderer();
-  else
-    featureRenderer = qobject_cast<QgsVectorLayer *>( layer.get() )->renderer();
+        QImage image( width, height, QImage::Format_ARGB32_Premultiplied );
 
-  QgsLayerTree qgsLayerTree;
-  qgsLayerTree.addLayer( layer.get() );
+        QPainter p( &image );
+        QgsRenderContext context = QgsRenderContext::fromQPainter( &p );
+        context.setFlag( Qgis::RenderContextFlag::Antialiasing, true );
 
-  QgsLayerTreeModel legendModel( &qgsLayerTree );
+        qreal dpmm = dpi / 25.4;
+        context.painter()->scale( dpmm, dpmm );
 
-  QImage image( width, height, QImage::Format_ARGB32_Premultiplied );
+        qreal canvasFrac = 0.8;
 
-  QPainter p( &image );
-  QgsRenderContext context = QgsRenderContext::fromQPainter( &p );
-  context.setFlag( Qgis::RenderContextFlag::Antialiasing, true );
+        QgsLayerTreeModelLegendNode::ItemContext ctx;
+        ctx.context = &context;
+        ctx.painter = context.painter();
+        ctx.columnLeft = ( 1 - canvasFrac ) / 2 * width / dpmm;
+        ctx.top = ( 1 - canvasFrac ) / 2 * height / dpmm;
+        mOrigin = QPointF( ctx.columnLeft, ctx.top );
 
-  int dpi = mSettings->outputDpi();
-  qreal dpmm = dpi / 25.4;
-  context.painter()->scale( dpmm, dpmm );
+        mSettings.setSymbolSize( QSizeF( canvasFrac * width / dpmm, canvasFrac * height / dpmm ) );
+        mSettings.setMaximumSymbolSize( canvasFrac * height / dpmm );
+
+        processLegendGroup( mModel->rootGroup()->children(), mSymbols, *mModel, mSettings, ctx, image, 0, rasterRenderer, featureRenderer, count, &mDeferredNodes );
+        p.end();
+      }
+
+      std::vector<HeadlessRender::LegendSymbol> &symbols() { return mSymbols; }
+      const DeferredLegendNodes &deferredNodes() const { return mDeferredNodes; }
+      const QgsLegendSettings &settings() const { return mSettings; }
+      const QPointF &origin() const { return mOrigin; }
+
+    private:
+      QgsLayerTree mTree;
+      std::unique_ptr<QgsLayerTreeModel> mModel;
+      QgsLegendSettings mSettings;
+      QPointF mOrigin;
+      std::vector<HeadlessRender::LegendSymbol> mSymbols;
+      DeferredLegendNodes mDeferredNodes;
+  };
+} // namespace
+
+static std::vector<HeadlessRender::LegendSymbol> drawLayerLegendSymbols(
+  const HeadlessRender::QgsMapLayerPtr &layer, const int width, const int height, const int count,
+  const int dpi
+)
+{
+  LayerLegend legend( layer, width, height, count, dpi );
+  drawLegendNodes( legend.deferredNodes(), legend.settings(), QSize( width, height ), dpi, legend.origin(), legend.symbols() );
+  return legend.symbols();
+}
+
+std::vector<HeadlessRender::LegendSymbol> HeadlessRender::MapRequest::
+  legendSymbols( const LayerIndex index, const HeadlessRender::Size &size /* = Size() */, const int count /* = InvalidValue */ )
+{
+  return drawLegendSymbols( index, size, count, mSettings->outputDpi() );
+}
+
+HeadlessRender::LegendSprite HeadlessRender::MapRequest::
+  legendSprite( const HeadlessRender::Size &size, const std::optional<int> &dpi /* = std::nullopt */, const int count /* = InvalidValue */ )
+{
+  const int width = std::get<0>( size );
+  const int height = std::get<1>( size );
+  if ( width <= 0 || height <= 0 )
+    throw QgisHeadlessError( InvalidSymbolSizeError );
+
+  const int spriteDpi = dpi.value_or( mSettings->outputDpi() );
+  const qreal dpmm = spriteDpi / 25.4;
+
+  // Symbols of vector layers are drawn straight into the sprite, so they aren't cached
+  std::vector<std::unique_ptr<LayerLegend>> legends;
+  std::size_t symbolCount = 0;
+  for ( const HeadlessRender::Layer &layer : mLayers )
+  {
+    legends.push_back( std::make_unique<LayerLegend>( layer.qgsMapLayer(), width, height, count, spriteDpi ) );
+    symbolCount += legends.back()->symbols().size();
+  }
+
+  // Nearly square grid of icons keeps the image within texture size limits of clients
+  const int columns = std::max( 1, static_cast<int>( std::ceil( std::sqrt( symbolCount ) ) ) );
+  const int rows = std::max( 1, static_cast<int>( ( symbolCount + columns - 1 ) / columns ) );
 
-  qreal canvasFrac = 0.8;
+  QImage sprite( columns * width, rows * height, QImage::Format_ARGB32_Premultiplied );
+  sprite.fill( Qt::transparent );
+
+  QJsonArray spriteIndex;
+  QPainter painter( &sprite );
+  QgsRenderContext context = QgsRenderContext::fromQPainter( &painter );
+  context.setFlag( Qgis::RenderContextFlag::Antialiasing, true );
 
   QgsLayerTreeModelLegendNode::ItemContext ctx;
   ctx.context = &context;
-  ctx.painter = context.painter();
-  ctx.columnLeft = ( 1 - canvasFrac ) / 2 * width / dpmm;
-  ctx.top = ( 1 - canvasFrac ) / 2 * height / dpmm;
+  ctx.painter = &painter;
+
+  std::size_t i = 0;
+  for ( LayerIndex layerIndex = 0; layerIndex < legends.size(); ++layerIndex )
+  {
+    LayerLegend &legend = *legends[layerIndex];
+    std::vector<QgsLayerTreeModelLegendNode *> nodes( legend.symbols().size(), nullptr );
+    for ( const auto &deferredNode : legend.deferredNodes() )
+      nodes[deferredNode.first] = deferredNode.second;
+
+    for ( std::size_t symbolIndex = 0; symbolIndex < nodes.size(); ++symbolIndex, ++i )
+    {
+      const LegendSymbol &symbol = legend.symbols()[symbolIndex];
+      const int x = static_cast<int>( i ) % columns * width;
+      const int y = static_cast<int>( i ) / columns * height;
+
+      if ( QgsLayerTreeModelLegendNode *node = nodes[symbolIndex] )
+      {
+        painter.save();
+        painter.setClipRect( x, y, width, height );
+        painter.translate( x, y );
+        painter.scale( dpmm, dpmm );
+        ctx.columnLeft = legend.origin().x();
+        ctx.top = legend.origin().y();
+#if _QGIS_VERSION_INT < 34405
+        node->draw( legend.settings(), &ctx );
+#else
+        node->draw( legend.settings(), ctx );
+#endif
+        painter.restore();
+      }
+      else if ( const ImagePtr icon = symbol.icon() )
+      {
+        const auto iconSize = icon->sizeWidthHeight();
+        painter.drawImage( x, y, QImage( icon->data(), iconSize.first, iconSize.second, QImage::Format_RGBA8888 ) );
+      }
+
+      QJsonObject item {
+        { "x", x },
+        { "y", y },
+        { "width", width },
+        { "height", height },
+        { "layer", static_cast<qint64>( layerIndex ) },
+        { "index", symbol.index() },
+        { "raster_band", symbol.rasterBand() },
+      };
+
+      // Titles and states follow LegendSymbol bindings: missing ones are null
+      const QString title = symbol.title();
+      if ( !symbol.hasTitle() || ( !symbol.hasCategory() && title.isEmpty() ) )
+        item.insert( "title", QJsonValue() );
+      else
+        item.insert( "title", title );
+
+      switch ( symbol.render() )
+      {
+        case SymbolRender::Checked:
+          item.insert( "render", true );
+          break;
+        case SymbolRender::Unchecked:
+          item.insert( "render", false );
+          break;
+        default:
+          item.insert( "render", QJsonValue() );
+          break;
+      }
+
+      spriteIndex.append( item );
+    }
+  }
+  painter.end();
+
+  QByteArray encoded;
+  QBuffer buffer( &encoded );
+  buffer.open( QIODevice::WriteOnly );
+  sprite.save( &buffer, "PNG" );
+
+  LegendSprite result;
+  result.image = std::make_shared<RawData>( encoded );
+  result.index = QJsonDocument( spriteIndex ).toJson( QJsonDocument::Compact ).toStdString();
+  return result;
+}
+
+std::vector<HeadlessRender::LegendSymbol> HeadlessRender::MapRequest::
+  drawLegendSymbols( const LayerIndex index, const HeadlessRender::Size &size, const int count, const int dpi )
+{
+  if ( mLayers.size() <= index )
+    throw QgisHeadlessError( InvalidLayerIndexError );
 
-  QgsLegendSettings legendSettings;
-  legendSettings.setSymbolSize( QSizeF( canvasFrac * width / dpmm, canvasFrac * height / dpmm ) );
-  legendSettings.setMaximumSymbolSize( canvasFrac * height / dpmm );
+  const QgsMapLayerPtr layer = mLayers.at( index ).qgsMapLayer();
+  const int width = std::get<0>( size );
+  const int height = std::get<1>( size );
 
-  std::vector<HeadlessRender::LegendSymbol> legendSymbols;
-  processLegendGroup( legendModel.rootGroup()->children(), legendSymbols, legendModel, legendSettings, ctx, image, 0, rasterRenderer, featureRenderer, count );
-  return legendSymbols;
+  // Layers of projects have no Style, so their legends are not cached
+  const QString &styleKey = mLegendStyles.at( index );
+  if ( styleKey.isEmpty() )
+    return drawLayerLegendSymbols( layer, width, height, count, dpi );
+
+  LegendCacheKey key { styleKey, layer->name(), QString(), width, height, dpi, count };
+  if ( auto *vectorLayer = qobject_cast<QgsVectorLayer *>( layer.get() ) )
+  {
+    QgsFeatureRenderer *renderer = vectorLayer->renderer();
+    if ( renderer && renderer->legendSymbolItemsCheckable() )
+    {
+      for ( const QgsLegendSymbolItem &item : renderer->legendSymbolItems() )
+        key.state.append( renderer->legendSymbolItemChecked( item.ruleKey() ) ? '1' : '0' );
+    }
+  }
+
+  return LegendCache::symbols( key, [&]() {
+    return drawLayerLegendSymbols( layer, width, height, count, dpi );
+  } );
 }
 
 void HeadlessRender::MapRequest::prepareForRendering( const QSize &outputSize, const QgsRectangle &extent )
 {
   mSettings->setOutputSize( outputSize );
   mSettings->setExtent( extent );
+
+  mFeatureFilterProvider->clearBindings();
+
+  QList<QgsMapLayer *> qgsMapLayers;
+  for ( LayerIndex index = 0; index < mLayers.size(); ++index )
+  {
+    const HeadlessRender::Layer &layer = mLayers[index];
+    const QgsMapLayerPtr qgsMapLayer = layer.qgsMapLayer();
+    QgsMapLayer *detailLevel = layer.qgsMapLayer(
+      layerUnitsPerPixel( *mSettings, qgsMapLayer.get() ), mSettings->destinationCrs()
+    ).get();
+
+    // Reprojected copy of the layer is in the map's CRS, while filter's extent is in layer's one
+    QgsCoordinateTransform extentTransform;
+    if ( detailLevel->crs() != qgsMapLayer->crs() )
+      extentTransform = CrsCache::transform( qgsMapLayer->crs(), detailLevel->crs() );
+
+    mFeatureFilterProvider->bindLayer( index, detailLevel, extentTransform );
+    qgsMapLayers.push_back( detailLevel );
+  }
+  mSettings->setLayers( qgsMapLayers );
   auto expressionContext = createExpressionContext( mSettings );
   expressionContext.lastScope()->addVariable(
     QgsExpressionContextScope::
@@ -581,6 +1010,21 @@ void HeadlessRender::MapRequest::prepareForRendering( const QSize &outputSize, c
   mSettings->setExpressionContext( expressionContext );
 }
 
+// Contrast enhancement of rendering extents is computed by raster layers with their own data
+// providers, while statistics computed by providers of rendering jobs' pipes are stored by
+// projectors of the pipes, see RasterBlockCache::install()
+void HeadlessRender::MapRequest::storeBandStatistics() const
+{
+  for ( const HeadlessRender::Layer &layer : mLayers )
+  {
+    if ( auto *rasterLayer = qobject_cast<QgsRasterLayer *>( layer.qgsMapLayer().get() ) )
+    {
+      if ( rasterLayer->dataProvider() )
+        BandStatisticsCache::store( rasterLayer->dataProvider() );
+    }
+  }
+}
+
 void HeadlessRender::MapRequest::applyRenderSymbols( const RenderSymbols &symbols )
 {
   for ( const auto &renderSymbolsItem : symbols )
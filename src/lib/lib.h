@@ -22,36 +22,58 @@
 #define QGIS_HEADLESS_H
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <tuple>
 #include <unordered_map>
+#include <QSizeF>
 
 #include "crs.h"
+#include "crs_cache.h"
 #include "layer.h"
+#include "layer_pool.h"
 #include "style.h"
+#include "style_cache.h"
+#include "svg_resolver.h"
+#include "symbol_cache.h"
+#include "expression_cache.h"
 #include "image.h"
 #include "legend_symbol.h"
+#include "legend_cache.h"
+#include "raster_block_cache.h"
+#include "band_statistics_cache.h"
 #include "raw_data.h"
 #include "project.h"
 
 class QImage;
 class QgsMapSettings;
 class QgsLayerTree;
+class QgsLayerTreeModel;
+class QgsLegendRenderer;
 class QgsRectangle;
 
 namespace HeadlessRender
 {
-  typedef size_t LayerIndex;
+  class FeatureFilterProvider;
+
   typedef std::shared_ptr<QgsMapSettings> QgsMapSettingsPtr;
   typedef std::shared_ptr<QgsLayerTree> QgsLayerTreePtr;
-  typedef std::tuple<double, double, double, double> Extent;
   typedef std::tuple<int, int> Size;
   typedef std::vector<LegendSymbol::Index> SymbolIndexVector;
   typedef std::unordered_map<LayerIndex, SymbolIndexVector> RenderSymbols;
 
   constexpr int DefaultRasterRenderSymbolCount = 5;
 
+  /**
+   * Legend symbols of all layers of a request, drawn into a single image.
+   */
+  struct LegendSprite
+  {
+      std::shared_ptr<RawData> image; // PNG-encoded image, symbols are placed in rows
+      std::string index;              // JSON array of symbols' rectangles, titles and states
+  };
+
   class QGIS_HEADLESS_EXPORT MapRequest
   {
     public:
@@ -59,7 +81,20 @@ namespace HeadlessRender
 
       void setDpi( int dpi );
       void setCrs( const CRS &crs );
-      LayerIndex addLayer( Layer &layer, Style &style, const std::string &label = "" );
+      /**
+       * Adds layer with style to the request.
+       * \param layer layer to render.
+       * \param style style applied to the layer.
+       * \param label name of the layer in legend.
+       * \param filter expression selecting features of vector layer rendered by this request.
+       * \param filterExtent extent in layer's CRS, features outside of it are not fetched.
+       * A layer with filter or extent can't be added to the same request more than once.
+       * \returns index of the added layer.
+       */
+      LayerIndex addLayer(
+        Layer &layer, Style &style, const std::string &label = "",
+        const std::string &filter = "", const std::optional<Extent> &filterExtent = std::nullopt
+      );
       void addProject( const Project &project );
 
       ImagePtr renderImage( const Extent &extent, const Size &size, const RenderSymbols &symbols = {} );
@@ -70,9 +105,22 @@ namespace HeadlessRender
         LayerIndex index, const Size &size = Size(), int count = DefaultRasterRenderSymbolCount
       );
 
+      /**
+       * Draws legend symbols of all layers into one image, so that a legend is fetched at once.
+       * Symbols are drawn straight into the image, bypassing LegendCache.
+       * \param size size of each symbol's icon in pixels.
+       * \param dpi resolution of icons, resolution of the request is used by default.
+       * \param count number of symbols, depicting single-band rasters.
+       */
+      LegendSprite legendSprite(
+        const Size &size, const std::optional<int> &dpi = std::nullopt,
+        int count = DefaultRasterRenderSymbolCount
+      );
+
     protected:
       /**
-       * Prepares mSettings for rendering
+       * Prepares mSettings for rendering, selecting layers' detail levels matching the resolution
+       * and binding layers' feature filters to them
        * \param outputSize size of the rendered image
        * \param extent extent for rendering
        */
@@ -80,11 +128,24 @@ namespace HeadlessRender
 
     private:
       void applyRenderSymbols( const RenderSymbols &symbols );
+      void storeBandStatistics() const;
+      QgsLegendRenderer &legendRenderer();
+      std::vector<LegendSymbol> drawLegendSymbols(
+        LayerIndex index, const Size &size, int count, int dpi
+      );
 
       QgsMapSettingsPtr mSettings;
       QgsLayerTreePtr mQgsLayerTree;
-      std::vector<QgsMapLayerPtr> mLayers;
+      std::vector<Layer> mLayers;
+      std::vector<QString> mLegendStyles; // keys of layers' legends in LegendCache
       RenderSymbols mDefaultRenderSymbols;
+      std::shared_ptr<FeatureFilterProvider> mFeatureFilterProvider;
+
+      // Legend model and its renderer, reused by renderLegend() until layers' styles change
+      std::shared_ptr<QgsLayerTreeModel> mLegendModel;
+      std::shared_ptr<QgsLegendRenderer> mLegendRenderer;
+      std::vector<quint64> mLegendStyleGenerations;
+      QSizeF mLegendMinimumSize;
   };
 
   QGIS_HEADLESS_EXPORT void init( int argc, char **argv );
@@ -0,0 +1,200 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_LRU_CACHE_H
+#define QGIS_HEADLESS_LRU_CACHE_H
+
+#include <functional>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "types.h"
+
+namespace HeadlessRender
+{
+  /**
+   * Least recently used cache with a limited total cost of entries.
+   * Each entry costs 1 by default, so the capacity limits the number of entries.
+   *
+   * \note Not thread-safe, callers are responsible for locking.
+   */
+  template<typename Key, typename Value, typename Hash = std::hash<Key>> class LruCache
+  {
+    public:
+      explicit LruCache( std::size_t capacity )
+        : mCapacity( capacity )
+      {}
+
+      /**
+       * Returns value for the key and marks it as recently used, or std::nullopt if key is missing.
+       */
+      std::optional<Value> get( const Key &key )
+      {
+        auto it = mIndex.find( key );
+        if ( it == mIndex.end() )
+        {
+          ++mStats.misses;
+          return std::nullopt;
+        }
+
+        ++mStats.hits;
+        mEntries.splice( mEntries.begin(), mEntries, it->second );
+        return it->second->value;
+      }
+
+      /**
+       * Returns value for the key like get(), but an entry, for which \a valid returns false, is
+       * removed and counted as invalidation and miss instead of hit.
+       */
+      std::optional<Value> get( const Key &key, const std::function<bool( const Value & )> &valid )
+      {
+        auto it = mIndex.find( key );
+        if ( it != mIndex.end() && !valid( it->second->value ) )
+        {
+          erase( key );
+          ++mStats.invalidations;
+        }
+        return get( key );
+      }
+
+      /**
+       * Inserts or replaces value for the key, evicting least recently used entries
+       * until the total cost fits into capacity.
+       */
+      void put( const Key &key, const Value &value, std::size_t cost = 1 )
+      {
+        erase( key );
+
+        mEntries.push_front( { key, value, cost } );
+        mIndex[key] = mEntries.begin();
+        mCost += cost;
+
+        evict();
+      }
+
+      /**
+       * Removes the key from cache, counting it as invalidation.
+       * \returns true if the key was present.
+       */
+      bool remove( const Key &key )
+      {
+        if ( !erase( key ) )
+          return false;
+
+        ++mStats.invalidations;
+        return true;
+      }
+
+      /**
+       * Removes all entries satisfying the predicate, counting them as invalidations.
+       */
+      void removeIf( const std::function<bool( const Key &, const Value & )> &predicate )
+      {
+        for ( auto it = mEntries.begin(); it != mEntries.end(); )
+        {
+          if ( predicate( it->key, it->value ) )
+          {
+            mCost -= it->cost;
+            mIndex.erase( it->key );
+            it = mEntries.erase( it );
+            ++mStats.invalidations;
+          }
+          else
+            ++it;
+        }
+      }
+
+      void clear()
+      {
+        mEntries.clear();
+        mIndex.clear();
+        mCost = 0;
+      }
+
+      void setCapacity( std::size_t capacity )
+      {
+        mCapacity = capacity;
+        evict();
+      }
+
+      std::size_t capacity() const
+      {
+        return mCapacity;
+      }
+
+      CacheStats stats() const
+      {
+        CacheStats stats = mStats;
+        stats.size = mEntries.size();
+        stats.cost = mCost;
+        stats.capacity = mCapacity;
+        return stats;
+      }
+
+      void resetStats()
+      {
+        mStats = CacheStats();
+      }
+
+    private:
+      struct Entry
+      {
+          Key key;
+          Value value;
+          std::size_t cost;
+      };
+
+      typedef std::list<Entry> Entries;
+
+      bool erase( const Key &key )
+      {
+        auto it = mIndex.find( key );
+        if ( it == mIndex.end() )
+          return false;
+
+        mCost -= it->second->cost;
+        mEntries.erase( it->second );
+        mIndex.erase( it );
+        return true;
+      }
+
+      void evict()
+      {
+        while ( mCost > mCapacity && !mEntries.empty() )
+        {
+          const Entry &entry = mEntries.back();
+          mCost -= entry.cost;
+          mIndex.erase( entry.key );
+          mEntries.pop_back();
+          ++mStats.evictions;
+        }
+      }
+
+      std::size_t mCapacity;
+      std::size_t mCost = 0;
+      Entries mEntries;
+      std::unordered_map<Key, typename Entries::iterator, Hash> mIndex;
+      CacheStats mStats;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_LRU_CACHE_H
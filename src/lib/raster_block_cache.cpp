@@ -0,0 +1,383 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "raster_block_cache.h"
+#include "band_statistics_cache.h"
+#include "lru_cache.h"
+#include "utils.h"
+
+#include <qgsrasterblock.h>
+#include <qgsrasterdataprovider.h>
+#include <qgsrasterlayer.h>
+#include <qgsrasterpipe.h>
+#include <qgsrasterprojector.h>
+#include <qgsrasterrange.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+  // Disabled by default, see RasterBlockCache
+  const std::size_t DEFAULT_CAPACITY = 0;
+
+  // Size of grid blocks in pixels of their resolution level
+  constexpr int BlockSize = 256;
+
+  // Levels are limited, so that their scale factor fits into int
+  constexpr int MaxLevel = 30;
+
+  struct RasterBlockKeyHash
+  {
+      std::size_t operator()( const HeadlessRender::RasterBlockKey &key ) const
+      {
+        std::size_t seed = qHash( key.source ) ^ ( qHash( key.noData ) << 1 );
+        seed ^= std::hash<qint64>()( key.mtime ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        seed ^= std::hash<qint64>()( key.size ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        seed ^= static_cast<std::size_t>( key.band ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        seed ^= static_cast<std::size_t>( key.level ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        seed ^= static_cast<std::size_t>( key.column ) + 0x9e3779b9 + ( seed << 6 )
+                + ( seed >> 2 );
+        seed ^= static_cast<std::size_t>( key.row ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+        return seed;
+      }
+  };
+
+  typedef std::shared_ptr<QgsRasterBlock> RasterBlockPtr;
+  typedef HeadlessRender::RasterBlockKey Key;
+  typedef HeadlessRender::LruCache<Key, RasterBlockPtr, RasterBlockKeyHash> Cache;
+
+  std::mutex cacheMutex;
+  Cache cache( DEFAULT_CAPACITY );
+
+  // User no-data values of the band, which the data provider applies to blocks it reads
+  QString noDataKey( QgsRasterInterface *input, int bandNo )
+  {
+    const auto *provider = dynamic_cast<const QgsRasterDataProvider *>( input );
+    if ( !provider )
+      return QString();
+
+    QStringList values;
+    values.append( provider->useSourceNoDataValue( bandNo ) ? QStringLiteral( "source" )
+                                                            : QString() );
+    for ( const QgsRasterRange &range : provider->userNoDataValues( bandNo ) )
+      values.append( QStringLiteral( "%1:%2:%3" )
+                       .arg( range.min(), 0, 'g', 17 )
+                       .arg( range.max(), 0, 'g', 17 )
+                       .arg( static_cast<int>( range.bounds() ) ) );
+    return values.join( ';' );
+  }
+
+  // Reads the block through the grid of cached blocks of the resolution level, which is the
+  // coarsest one not coarser than requested, picking the nearest pixels of them
+  QgsRasterBlock *readCached(
+    QgsRasterInterface *input, const QString &source, int bandNo, const QgsRectangle &extent,
+    int width, int height, QgsRasterBlockFeedback *feedback
+  )
+  {
+    const QgsRectangle sourceExtent = input->extent();
+    const int sourceWidth = input->xSize();
+    const int sourceHeight = input->ySize();
+    if ( sourceWidth <= 0 || sourceHeight <= 0 || width <= 0 || height <= 0 || extent.isEmpty()
+         || HeadlessRender::RasterBlockCache::capacity() == 0 )
+      return input->block( bandNo, extent, width, height, feedback );
+
+    const double nativeX = sourceExtent.width() / sourceWidth;
+    const double nativeY = sourceExtent.height() / sourceHeight;
+    const double requestX = extent.width() / width;
+    const double requestY = extent.height() / height;
+
+    const double scale = std::min( requestX / nativeX, requestY / nativeY );
+    const int level = scale > 1 ? std::min( static_cast<int>( std::log2( scale ) ), MaxLevel ) : 0;
+    const double levelX = std::ldexp( nativeX, level );
+    const double levelY = std::ldexp( nativeY, level );
+    const int levelWidth = static_cast<int>( std::ceil( std::ldexp( sourceWidth, -level ) ) );
+    const int levelHeight = static_cast<int>( std::ceil( std::ldexp( sourceHeight, -level ) ) );
+
+    // Level pixels, nearest to centers of requested pixels, -1 outside of the source
+    std::vector<int> columns( width );
+    for ( int i = 0; i < width; ++i )
+    {
+      const double x = extent.xMinimum() + ( i + 0.5 ) * requestX;
+      const int column = static_cast<int>(
+        std::floor( ( x - sourceExtent.xMinimum() ) / levelX )
+      );
+      columns[i] = column >= 0 && column < levelWidth ? column : -1;
+    }
+    std::vector<int> rows( height );
+    for ( int j = 0; j < height; ++j )
+    {
+      const double y = extent.yMaximum() - ( j + 0.5 ) * requestY;
+      const int row = static_cast<int>( std::floor( ( sourceExtent.yMaximum() - y ) / levelY ) );
+      rows[j] = row >= 0 && row < levelHeight ? row : -1;
+    }
+
+    int minColumn = levelWidth, maxColumn = -1, minRow = levelHeight, maxRow = -1;
+    for ( const int column : columns )
+    {
+      if ( column >= 0 )
+      {
+        minColumn = std::min( minColumn, column / BlockSize );
+        maxColumn = std::max( maxColumn, column / BlockSize );
+      }
+    }
+    for ( const int row : rows )
+    {
+      if ( row >= 0 )
+      {
+        minRow = std::min( minRow, row / BlockSize );
+        maxRow = std::max( maxRow, row / BlockSize );
+      }
+    }
+
+    const Qgis::DataType type = input->dataType( bandNo );
+    auto output = std::make_unique<QgsRasterBlock>( type, width, height );
+    if ( !output->isValid() )
+      return input->block( bandNo, extent, width, height, feedback );
+
+    const HeadlessRender::SourceState state = HeadlessRender::sourceState( source );
+    const QString noData = noDataKey( input, bandNo );
+
+    const int blockColumns = maxColumn - minColumn + 1;
+    std::vector<RasterBlockPtr> blocks;
+    for ( int blockRow = minRow; blockRow <= maxRow; ++blockRow )
+    {
+      for ( int blockColumn = minColumn; blockColumn <= maxColumn; ++blockColumn )
+      {
+        const HeadlessRender::RasterBlockKey key {
+          source, state.mtime, state.size, noData, bandNo, level, blockColumn, blockRow
+        };
+        RasterBlockPtr block = HeadlessRender::RasterBlockCache::block( key, [&]() {
+          const int blockWidth = std::min( BlockSize, levelWidth - blockColumn * BlockSize );
+          const int blockHeight = std::min( BlockSize, levelHeight - blockRow * BlockSize );
+          const QgsRectangle blockExtent(
+            sourceExtent.xMinimum() + blockColumn * BlockSize * levelX,
+            sourceExtent.yMaximum() - ( blockRow * BlockSize + blockHeight ) * levelY,
+            sourceExtent.xMinimum() + ( blockColumn * BlockSize + blockWidth ) * levelX,
+            sourceExtent.yMaximum() - blockRow * BlockSize * levelY
+          );
+
+          RasterBlockPtr read(
+            input->block( bandNo, blockExtent, blockWidth, blockHeight, feedback )
+          );
+          // Blocks of canceled requests may be incomplete
+          if ( !read || !read->isValid() || read->dataType() != type
+               || ( feedback && feedback->isCanceled() ) )
+            return RasterBlockPtr();
+          return read;
+        } );
+
+        if ( !block )
+          return input->block( bandNo, extent, width, height, feedback );
+        if ( block->hasNoDataValue() && !output->hasNoDataValue() )
+          output->setNoDataValue( block->noDataValue() );
+        blocks.push_back( block );
+      }
+    }
+
+    const int typeSize = QgsRasterBlock::typeSize( type );
+    for ( int j = 0; j < height; ++j )
+    {
+      for ( int i = 0; i < width; ++i )
+      {
+        if ( rows[j] < 0 || columns[i] < 0 )
+        {
+          output->setIsNoData( j, i );
+          continue;
+        }
+
+        const std::size_t index = ( rows[j] / BlockSize - minRow ) * blockColumns
+                                  + columns[i] / BlockSize - minColumn;
+        QgsRasterBlock *block = blocks[index].get();
+        const int row = rows[j] % BlockSize;
+        const int column = columns[i] % BlockSize;
+        if ( block->isNoData( row, column ) )
+          output->setIsNoData( j, i );
+        else
+          std::memcpy( output->bits( j, i ), block->bits( row, column ), typeSize );
+      }
+    }
+
+    return output.release();
+  }
+
+  /**
+   * Reads the source through the cache of blocks.
+   */
+  class CachedRasterInput : public QgsRasterInterface
+  {
+    public:
+      CachedRasterInput( QgsRasterInterface *input, const QString &source )
+        : QgsRasterInterface( input )
+        , mSource( source )
+      {}
+
+      QgsRasterInterface *clone() const override
+      {
+        return new CachedRasterInput( mInput, mSource );
+      }
+
+      Qgis::DataType dataType( int bandNo ) const override
+      {
+        return mInput->dataType( bandNo );
+      }
+
+      int bandCount() const override
+      {
+        return mInput->bandCount();
+      }
+
+      QgsRasterBlock *block(
+        int bandNo, const QgsRectangle &extent, int width, int height,
+        QgsRasterBlockFeedback *feedback = nullptr
+      ) override
+      {
+        return readCached( mInput, mSource, bandNo, extent, width, height, feedback );
+      }
+
+    private:
+      QString mSource;
+  };
+
+  /**
+   * Projector, which reads the source of the pipe through CachedRasterInput, if CRSes differ.
+   */
+  class CachingRasterProjector : public QgsRasterProjector
+  {
+    public:
+      QgsRasterProjector *clone() const override
+      {
+        CachingRasterProjector *projector = new CachingRasterProjector();
+        projector->setCrs( sourceCrs(), destinationCrs(), QgsCoordinateTransformContext() );
+        projector->setPrecision( precision() );
+        return projector;
+      }
+
+      QgsRasterBlock *block(
+        int bandNo, const QgsRectangle &extent, int width, int height,
+        QgsRasterBlockFeedback *feedback = nullptr
+      ) override
+      {
+        // The first interface of the pipe, which reads the data provider
+        QgsRasterInterface *consumer = this;
+        while ( consumer->input() && consumer->input()->input() )
+          consumer = consumer->input();
+
+        auto *provider = dynamic_cast<QgsRasterDataProvider *>( consumer->input() );
+
+        QgsRasterBlock *result = nullptr;
+        if ( !provider || !sourceCrs().isValid() || !destinationCrs().isValid()
+             || sourceCrs() == destinationCrs() )
+          result = QgsRasterProjector::block( bandNo, extent, width, height, feedback );
+        else
+        {
+          // Pipe is cloned for each rendering job, so its input is replaced only for this call
+          CachedRasterInput cachedInput( provider, provider->dataSourceUri() );
+          consumer->setInput( &cachedInput );
+          result = QgsRasterProjector::block( bandNo, extent, width, height, feedback );
+          consumer->setInput( provider );
+        }
+
+        // Statistics, computed by the provider of the job's pipe, are lost with the pipe
+        if ( provider )
+          HeadlessRender::BandStatisticsCache::store( provider );
+        return result;
+      }
+  };
+} // namespace
+
+bool HeadlessRender::RasterBlockKey::operator==( const RasterBlockKey &other ) const
+{
+  return band == other.band && level == other.level && column == other.column && row == other.row
+         && mtime == other.mtime && size == other.size && source == other.source
+         && noData == other.noData;
+}
+
+void HeadlessRender::RasterBlockCache::install( QgsRasterLayer *layer )
+{
+  layer->pipe()->set( new CachingRasterProjector() );
+}
+
+std::shared_ptr<QgsRasterBlock> HeadlessRender::RasterBlockCache::block(
+  const RasterBlockKey &key, const std::function<std::shared_ptr<QgsRasterBlock>()> &read
+)
+{
+  {
+    std::lock_guard<std::mutex> lock( cacheMutex );
+    if ( std::optional<RasterBlockPtr> block = cache.get( key ) )
+      return *block;
+  }
+
+  // Blocks are read outside of the lock, so other requests are not blocked
+  const RasterBlockPtr block = read();
+  if ( !block )
+    return block;
+
+  const std::size_t cost = static_cast<std::size_t>( block->width() ) * block->height()
+                           * QgsRasterBlock::typeSize( block->dataType() );
+
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.put( key, block, cost );
+  return block;
+}
+
+QgsRasterBlock *HeadlessRender::RasterBlockCache::read(
+  QgsRasterInterface *input, const QString &source, int band, const QgsRectangle &extent,
+  int width, int height, QgsRasterBlockFeedback *feedback /* = nullptr */
+)
+{
+  return readCached( input, source, band, extent, width, height, feedback );
+}
+
+void HeadlessRender::RasterBlockCache::invalidate( const QString &source )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.removeIf( [&source]( const Key &key, const RasterBlockPtr & ) {
+    return key.source == source;
+  } );
+}
+
+void HeadlessRender::RasterBlockCache::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.setCapacity( capacity );
+}
+
+std::size_t HeadlessRender::RasterBlockCache::capacity()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return cache.capacity();
+}
+
+HeadlessRender::CacheStats HeadlessRender::RasterBlockCache::stats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return cache.stats();
+}
+
+void HeadlessRender::RasterBlockCache::clear()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.clear();
+  cache.resetStats();
+}
@@ -0,0 +1,126 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_RASTER_BLOCK_CACHE_H
+#define QGIS_HEADLESS_RASTER_BLOCK_CACHE_H
+
+#include <functional>
+#include <memory>
+#include <QString>
+#include "types.h"
+
+class QgsRasterBlock;
+class QgsRasterBlockFeedback;
+class QgsRasterInterface;
+class QgsRasterLayer;
+class QgsRectangle;
+
+namespace HeadlessRender
+{
+  /**
+   * Identifies a block of raster data, decoded at one of the resolution levels of the source.
+   * Level 0 has the native resolution of the source, each next level is twice as coarse.
+   */
+  struct RasterBlockKey
+  {
+      QString source; // URI of raster data provider
+      qint64 mtime = -1; // modification time and size of the source file, -1 if it's not a file
+      qint64 size = -1;
+      QString noData; // user no-data values of the band, applied by the provider
+      int band = 0;
+      int level = 0;
+      int column = 0;
+      int row = 0;
+
+      bool operator==( const RasterBlockKey &other ) const;
+  };
+
+  /**
+   * Process-wide thread-safe cache of decoded source blocks of raster layers, which are rendered
+   * in a CRS different from their own. Projected tiles read the source through a fixed grid of
+   * blocks, so overlapping tiles reuse blocks instead of reading and resampling them again.
+   * Capacity is a budget of bytes, occupied by pixels of cached blocks.
+   *
+   * The cache is disabled by default, as pixels are picked from power-of-two resolution levels
+   * by nearest neighbour, so output differs from the one of reading the source directly.
+   * Enable it with setCapacity().
+   */
+  class QGIS_HEADLESS_EXPORT RasterBlockCache
+  {
+    public:
+      /**
+       * Makes the raster layer read its source through the cache, when it's rendered in another
+       * CRS. Band statistics, computed by data providers of rendering jobs' pipes, are passed to
+       * BandStatisticsCache as well.
+       */
+      static void install( QgsRasterLayer *layer );
+
+      /**
+       * Reads data of the source's band through the cache. Data is taken from cached blocks of the
+       * coarsest resolution level, which is not coarser than requested, by nearest neighbour.
+       * \param input interface reading the source, usually its data provider.
+       * \param source URI of the source, identifying its blocks in the cache.
+       * \returns new block owned by the caller.
+       */
+      static QgsRasterBlock *read(
+        QgsRasterInterface *input, const QString &source, int band, const QgsRectangle &extent,
+        int width, int height, QgsRasterBlockFeedback *feedback = nullptr
+      );
+
+      /**
+       * Returns the block from the cache, reading it with \a read on miss. Blocks, which could not
+       * be read, are returned as nullptr and not cached. Cached blocks must not be modified.
+       */
+      static std::shared_ptr<QgsRasterBlock> block(
+        const RasterBlockKey &key, const std::function<std::shared_ptr<QgsRasterBlock>()> &read
+      );
+
+      /**
+       * Removes blocks of the source from the cache, e.g. after its overviews changed.
+       */
+      static void invalidate( const QString &source );
+
+      /**
+       * Sets maximum number of bytes occupied by cached blocks, least recently used blocks are
+       * evicted. Zero capacity, which is the default, disables the cache.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns maximum number of bytes occupied by cached blocks.
+       */
+      static std::size_t capacity();
+
+      /**
+       * Returns hit, miss and eviction counters of the cache, cost is the number of cached bytes.
+       */
+      static CacheStats stats();
+
+      /**
+       * Removes all blocks from the cache and resets statistics.
+       */
+      static void clear();
+
+    private:
+      RasterBlockCache() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_RASTER_BLOCK_CACHE_H
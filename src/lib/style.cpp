@@ -21,16 +21,22 @@
 #include "style.h"
 
 #include "exceptions.h"
+#include "expression_cache.h"
 #include "utils.h"
 
 #include <qgscallout.h>
+#include <qgscategorizedsymbolrenderer.h>
 #include <qgsdiagramrenderer.h>
+#include <qgsexception.h>
 #include <qgsexpressioncontext.h>
 #include <qgsfeaturerequest.h>
 #include <qgsfillsymbol.h>
 #include <qgsfillsymbollayer.h>
+#include <qgsgeometrygeneratorsymbollayer.h>
+#include <qgsgraduatedsymbolrenderer.h>
 #include <qgslinesymbol.h>
 #include <qgslinesymbollayer.h>
+#include <qgsmaplayerstyle.h>
 #include <qgsmaplayerstylemanager.h>
 #include <qgsmarkersymbol.h>
 #include <qgsmarkersymbollayer.h>
@@ -40,12 +46,23 @@
 #include <qgsrendercontext.h>
 #include <qgsrenderer.h>
 #include <qgsrulebasedlabeling.h>
+#include <qgsrulebasedrenderer.h>
 #include <qgssinglesymbolrenderer.h>
+#include <qgssymbollayerutils.h>
+#include <qgstextformat.h>
 #include <qgsvectorlayerlabeling.h>
+#include <qgswkbtypes.h>
 
+#include <QCryptographicHash>
 #include <QFile>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
 #include <QUrl>
 
+#include <algorithm>
+
 namespace HeadlessRender
 {
   namespace TAGS
@@ -81,7 +98,13 @@ namespace HeadlessRender
     const QString StyleMismatch = "Style type mismatch";
     const QString LayerStyleMismatch = "Layer type and style type do not match";
     const QString AddStyleFailed = "AddStyle failed";
+    const QString ValidationFailed = "Unknown error while validating style";
   } //namespace ErrorString
+
+  const QString StyleNamePrefix = "Style_";
+
+  // Number of styles with StyleNamePrefix, kept in a layer's style manager
+  const int MaxLayerStyles = 16;
 } //namespace HeadlessRender
 
 using namespace HeadlessRender;
@@ -94,51 +117,79 @@ const StyleCategory Style::DefaultImportCategories = QgsMapLayer::Symbology
 
 namespace
 {
-  QString resolveSvgPath( const QString &path, const SvgResolverCallback &svgResolverCallback )
+  // Paths of SVG files, mapped to resolved ones, only changed paths are present
+  typedef QHash<QString, QString> ResolvedPaths;
+
+  void appendPath( QStringList &paths, const QString &path )
+  {
+    if ( !path.isEmpty() && !paths.contains( path ) )
+      paths.append( path );
+  }
+
+  void collectSymbolSvgPaths( const QgsSymbol *symbol, QStringList &paths )
   {
-    if ( !svgResolverCallback )
+    for ( QgsSymbolLayer *symbolLayer : symbol->symbolLayers() )
     {
-      return path;
+      if ( symbolLayer->layerType() == SymbolLayerType::SvgMarker )
+        appendPath( paths, static_cast<QgsSvgMarkerSymbolLayer *>( symbolLayer )->path() );
+      else if ( symbolLayer->layerType() == SymbolLayerType::SVGFill )
+        appendPath( paths, static_cast<QgsSVGFillSymbolLayer *>( symbolLayer )->svgFilePath() );
+
+      if ( symbolLayer->subSymbol() )
+        collectSymbolSvgPaths( symbolLayer->subSymbol(), paths );
     }
-    return QString::fromStdString( svgResolverCallback( path.toStdString() ) );
   }
 
-  void resolveSymbol( QgsSymbol *symbol, const SvgResolverCallback &svgResolverCallback )
+  void collectLabelingSvgPaths(
+    const QgsAbstractVectorLayerLabeling *labeling, QStringList &paths
+  )
+  {
+    const QgsTextBackgroundSettings background = labeling->settings().format().background();
+    if ( background.type() == QgsTextBackgroundSettings::ShapeMarkerSymbol )
+      collectSymbolSvgPaths( background.markerSymbol(), paths );
+    else if ( background.type() == QgsTextBackgroundSettings::ShapeSVG )
+      appendPath( paths, background.svgFile() );
+  }
+
+  void resolveSymbol( QgsSymbol *symbol, const ResolvedPaths &resolvedPaths )
   {
     for ( QgsSymbolLayer *symbolLayer : symbol->symbolLayers() )
     {
       if ( symbolLayer->layerType() == SymbolLayerType::SvgMarker )
       {
         auto svgMarkerSymbolLayer = dynamic_cast<QgsSvgMarkerSymbolLayer *>( symbolLayer );
-        const QColor fillColor = svgMarkerSymbolLayer->fillColor();
-        const QColor strokeColor = svgMarkerSymbolLayer->strokeColor();
-        const double strokeWidth = svgMarkerSymbolLayer->strokeWidth();
+        auto it = resolvedPaths.constFind( svgMarkerSymbolLayer->path() );
+        if ( it != resolvedPaths.constEnd() )
+        {
+          const QColor fillColor = svgMarkerSymbolLayer->fillColor();
+          const QColor strokeColor = svgMarkerSymbolLayer->strokeColor();
+          const double strokeWidth = svgMarkerSymbolLayer->strokeWidth();
 
-        svgMarkerSymbolLayer->setPath(
-          resolveSvgPath( svgMarkerSymbolLayer->path(), svgResolverCallback )
-        );
+          svgMarkerSymbolLayer->setPath( it.value() );
 
-        svgMarkerSymbolLayer->setFillColor( fillColor );
-        svgMarkerSymbolLayer->setStrokeColor( strokeColor );
-        svgMarkerSymbolLayer->setStrokeWidth( strokeWidth );
+          svgMarkerSymbolLayer->setFillColor( fillColor );
+          svgMarkerSymbolLayer->setStrokeColor( strokeColor );
+          svgMarkerSymbolLayer->setStrokeWidth( strokeWidth );
+        }
       }
       else if ( symbolLayer->layerType() == SymbolLayerType::SVGFill )
       {
         auto svgFillSymbolLayer = dynamic_cast<QgsSVGFillSymbolLayer *>( symbolLayer );
 
-        auto path = svgFillSymbolLayer->svgFilePath();
-        svgFillSymbolLayer->setSvgFilePath( resolveSvgPath( path, svgResolverCallback ) );
+        auto it = resolvedPaths.constFind( svgFillSymbolLayer->svgFilePath() );
+        if ( it != resolvedPaths.constEnd() )
+          svgFillSymbolLayer->setSvgFilePath( it.value() );
       }
 
       if ( symbolLayer->subSymbol() )
       {
-        resolveSymbol( symbolLayer->subSymbol(), svgResolverCallback );
+        resolveSymbol( symbolLayer->subSymbol(), resolvedPaths );
       }
     }
   }
 
   void resolveLabelingSvgPaths(
-    QgsAbstractVectorLayerLabeling *labeling, const SvgResolverCallback &svgResolverCallback
+    QgsAbstractVectorLayerLabeling *labeling, const ResolvedPaths &resolvedPaths
   )
   {
     auto settings = std::make_unique<QgsPalLayerSettings>( labeling->settings() );
@@ -146,19 +197,290 @@ namespace
     auto &&backgound = format.background();
     if ( backgound.type() == QgsTextBackgroundSettings::ShapeMarkerSymbol )
     {
-      resolveSymbol( backgound.markerSymbol(), svgResolverCallback );
+      resolveSymbol( backgound.markerSymbol(), resolvedPaths );
     }
     else if ( backgound.type() == QgsTextBackgroundSettings::ShapeSVG )
     {
-      backgound.setSvgFile( resolveSvgPath( backgound.svgFile(), svgResolverCallback ) );
+      backgound.setSvgFile( resolvedPaths.value( backgound.svgFile(), backgound.svgFile() ) );
     }
     settings->setFormat( format );
     labeling->setSettings( settings.release() );
   }
+
+  void memoizeProperties( QgsPropertyCollection &properties )
+  {
+    for ( int key : properties.propertyKeys() )
+    {
+      QgsProperty property = properties.property( key );
+#if _QGIS_VERSION_INT < 33600
+      if ( property.propertyType() != QgsProperty::ExpressionBasedProperty )
+#else
+      if ( property.propertyType() != Qgis::PropertyType::Expression )
+#endif
+        continue;
+
+      property.setExpressionString(
+        ExpressionCache::memoizedExpression( property.expressionString() )
+      );
+      properties.setProperty( key, property );
+    }
+  }
+
+  void memoizeSymbol( QgsSymbol *symbol )
+  {
+    memoizeProperties( symbol->dataDefinedProperties() );
+    for ( QgsSymbolLayer *symbolLayer : symbol->symbolLayers() )
+    {
+      memoizeProperties( symbolLayer->dataDefinedProperties() );
+      if ( symbolLayer->subSymbol() )
+        memoizeSymbol( symbolLayer->subSymbol() );
+    }
+  }
+
+  void memoizeLabeling( QgsAbstractVectorLayerLabeling *labeling )
+  {
+    for ( const QString &providerId : labeling->subProviders() )
+    {
+      auto settings = std::make_unique<QgsPalLayerSettings>( labeling->settings( providerId ) );
+      memoizeProperties( settings->dataDefinedProperties() );
+      if ( settings->isExpression )
+        settings->fieldName = ExpressionCache::memoizedExpression( settings->fieldName );
+      labeling->setSettings( settings.release(), providerId );
+    }
+  }
+
+  void collectPropertyExpressions(
+    const QgsPropertyCollection &properties, QStringList &expressions
+  )
+  {
+    for ( int key : properties.propertyKeys() )
+    {
+      const QgsProperty property = properties.property( key );
+#if _QGIS_VERSION_INT < 33600
+      if ( property.propertyType() == QgsProperty::ExpressionBasedProperty )
+#else
+      if ( property.propertyType() == Qgis::PropertyType::Expression )
+#endif
+        expressions.append( property.expressionString() );
+    }
+  }
+
+  void collectSymbolExpressions( QgsSymbol *symbol, QStringList &expressions )
+  {
+    collectPropertyExpressions( symbol->dataDefinedProperties(), expressions );
+    for ( QgsSymbolLayer *symbolLayer : symbol->symbolLayers() )
+    {
+      collectPropertyExpressions( symbolLayer->dataDefinedProperties(), expressions );
+      if ( auto *generator = dynamic_cast<QgsGeometryGeneratorSymbolLayer *>( symbolLayer ) )
+        expressions.append( generator->geometryExpression() );
+      if ( symbolLayer->subSymbol() )
+        collectSymbolExpressions( symbolLayer->subSymbol(), expressions );
+    }
+  }
+
+  /**
+   * Returns true, if rendering of the layer depends on geometries in layer's CRS or on feature
+   * ids: expressions of its renderer or labeling use geometry, like $area or $x, or $id.
+   */
+  bool usesSourceFeatures( QgsVectorLayer *layer )
+  {
+    QStringList expressions;
+    if ( QgsFeatureRenderer *renderer = layer->renderer() )
+    {
+      if ( renderer->filterNeedsGeometry() )
+        return true;
+
+      QgsRenderContext renderContext;
+      for ( QgsSymbol *symbol : renderer->symbols( renderContext ) )
+        collectSymbolExpressions( symbol, expressions );
+
+      if ( auto *ruleBasedRenderer = dynamic_cast<QgsRuleBasedRenderer *>( renderer ) )
+      {
+        for ( QgsRuleBasedRenderer::Rule *rule : ruleBasedRenderer->rootRule()->descendants() )
+          expressions.append( rule->filterExpression() );
+      }
+      else if ( auto *categorized = dynamic_cast<QgsCategorizedSymbolRenderer *>( renderer ) )
+        expressions.append( categorized->classAttribute() );
+      else if ( auto *graduated = dynamic_cast<QgsGraduatedSymbolRenderer *>( renderer ) )
+        expressions.append( graduated->classAttribute() );
+    }
+
+    if ( QgsAbstractVectorLayerLabeling *labeling = layer->labeling() )
+    {
+      for ( const QString &providerId : labeling->subProviders() )
+      {
+        const QgsPalLayerSettings settings = labeling->settings( providerId );
+        collectPropertyExpressions( settings.dataDefinedProperties(), expressions );
+        if ( settings.isExpression )
+          expressions.append( settings.fieldName );
+      }
+
+      if ( auto *ruleBasedLabeling = dynamic_cast<QgsRuleBasedLabeling *>( labeling ) )
+      {
+        for ( QgsRuleBasedLabeling::Rule *rule : ruleBasedLabeling->rootRule()->descendants() )
+          expressions.append( rule->filterExpression() );
+      }
+    }
+
+    for ( const QString &expression : expressions )
+    {
+      if ( expression.isEmpty() )
+        continue;
+
+      const QgsExpression qgsExpression( expression );
+      const QSet<QString> variables = qgsExpression.referencedVariables();
+      if ( qgsExpression.needsGeometry()
+           || qgsExpression.referencedFunctions().contains( QStringLiteral( "$id" ) )
+           || variables.contains( QStringLiteral( "geometry" ) )
+           || variables.contains( QStringLiteral( "feature" ) )
+           || variables.contains( QStringLiteral( "id" ) ) )
+        return true;
+    }
+    return false;
+  }
+
+  bool hasGeometryType( const QDomDocument &styleData )
+  {
+    return !styleData.firstChildElement( TAGS::QGIS )
+              .firstChildElement( TAGS::LAYER_GEOMETRY_TYPE )
+              .text()
+              .isEmpty();
+  }
+
+  // Returns style of the layer. Temporary layers of styles without geometry type are point ones,
+  // so the type written by the layer is removed, otherwise QGIS refuses to apply the style to
+  // lines and polygons.
+  QString compileStyle( QgsMapLayer *layer, bool keepGeometryType )
+  {
+    QgsMapLayerStyle style;
+    style.readFromLayer( layer );
+    if ( keepGeometryType )
+      return style.xmlData();
+
+    QDomDocument styleData;
+    styleData.setContent( style.xmlData() );
+    QDomElement root = styleData.firstChildElement( TAGS::QGIS );
+    const QDomElement geometryType = root.firstChildElement( TAGS::LAYER_GEOMETRY_TYPE );
+    if ( geometryType.isNull() )
+      return style.xmlData();
+
+    root.removeChild( geometryType );
+    return styleData.toString();
+  }
+
+  QString styleName( const QString &styleData )
+  {
+    const QByteArray hash = QCryptographicHash::hash(
+      styleData.toUtf8(), QCryptographicHash::Sha1
+    );
+    return StyleNamePrefix + hash.toHex();
+  }
+
+  DataType styleDataType( const QDomDocument &styleData )
+  {
+    bool isRaster = false;
+    QDomElement root = styleData.firstChildElement( TAGS::QGIS );
+
+    QDomNode pipeNode = root.firstChildElement( TAGS::PIPE );
+    if ( pipeNode.isNull() )
+    {
+      // old project
+      pipeNode = root;
+    }
+    else
+    {
+      QDomNode providerNode = pipeNode.firstChildElement( TAGS::PROVIDER );
+      if ( !providerNode.isNull() )
+      {
+        QDomNode resamplingNode = providerNode.firstChildElement( TAGS::RESAMPLING );
+        isRaster = !resamplingNode.isNull();
+      }
+    }
+
+    if ( !isRaster )
+    {
+      QDomElement rendererElement;
+      //rasterlayerproperties element there -> old format (1.8 and early 1.9)
+      if ( !root.firstChildElement( TAGS::RASTER_PROPERTIES ).isNull() )
+        rendererElement = root.firstChildElement( TAGS::RASTER_RENDERER );
+      else
+        rendererElement = pipeNode.firstChildElement( TAGS::RASTER_RENDERER );
+
+      isRaster = !rendererElement.isNull();
+    }
+
+    return isRaster ? DataType::Raster : DataType::Vector;
+  }
+
+  class ValidationTask : public QRunnable
+  {
+    public:
+      ValidationTask( const Style::ValidationRequest &request, Style::ValidationResult &result )
+        : mRequest( request )
+        , mResult( result )
+      {}
+
+      void run() override
+      {
+        try
+        {
+          const Style style = Style::fromString(
+            mRequest.data, nullptr, mRequest.layerGeometryType, mRequest.layerType,
+            mRequest.format
+          );
+          if ( style.type() == DataType::Vector )
+            mResult.usedAttributes = style.usedAttributes();
+          mResult.scaleRange = style.scaleRange();
+          mResult.valid = true;
+        }
+        catch ( const std::exception &e )
+        {
+          mResult.error = e.what();
+        }
+        catch ( const QgsException &e )
+        {
+          mResult.error = e.what().toStdString();
+        }
+        catch ( ... )
+        {
+          // Exceptions must not escape QRunnable::run(), which would terminate the process
+          mResult.error = ErrorString::ValidationFailed.toStdString();
+        }
+      }
+
+    private:
+      const Style::ValidationRequest &mRequest;
+      Style::ValidationResult &mResult;
+  };
+
+  Qgis::WkbType styleWkbType( const QDomDocument &styleData )
+  {
+    QDomElement myRoot = styleData.firstChildElement( TAGS::QGIS );
+    if ( myRoot.isNull() )
+      return Qgis::WkbType::Point;
+
+    switch ( static_cast<Qgis::GeometryType>(
+      myRoot.firstChildElement( TAGS::LAYER_GEOMETRY_TYPE ).text().toInt()
+    ) )
+    {
+      case Qgis::GeometryType::Point:
+        return Qgis::WkbType::Point;
+      case Qgis::GeometryType::Line:
+        return Qgis::WkbType::LineString;
+      case Qgis::GeometryType::Polygon:
+        return Qgis::WkbType::Polygon;
+      case Qgis::GeometryType::Unknown:
+        return Qgis::WkbType::Unknown;
+      case Qgis::GeometryType::Null:
+        return Qgis::WkbType::NoGeometry;
+    }
+
+    return Qgis::WkbType::Point;
+  }
 } //namespace
 
 Style Style::fromString(
-  const std::string &data, const SvgResolverCallback &svgResolverCallback /* = nullptr */,
+  const std::string &data, const SvgResolver &svgResolver /* = nullptr */,
   LayerGeometryType layerGeometryType /* = LayerGeometryType::Undefined */,
   DataType layerType /* = DataType::Unknown */, StyleFormat format /* = StyleFormat::QML */
 )
@@ -168,7 +490,7 @@ Style Style::fromString(
   {
     case StyleFormat::QML:
       style.init(
-        { QString::fromStdString( data ), svgResolverCallback, layerGeometryType, layerType }
+        { QString::fromStdString( data ), svgResolver, layerGeometryType, layerType }
       );
       break;
     case StyleFormat::SLD:
@@ -198,7 +520,7 @@ Style Style::fromString(
         throw StyleValidationError( "Cannot import SLD style, error: " + errorMessage );
 
       layer->exportNamedStyle( styleDom, errorMessage, {}, static_cast<QgsMapLayer::StyleCategory>( DefaultImportCategories ) );
-      style.init( { styleDom.toString(), svgResolverCallback, layerGeometryType, layerType } );
+      style.init( { styleDom.toString(), svgResolver, layerGeometryType, layerType } );
 
       break;
   }
@@ -206,8 +528,23 @@ Style Style::fromString(
   return style;
 }
 
+std::vector<Style::ValidationResult> Style::validateMany(
+  const std::vector<ValidationRequest> &requests
+)
+{
+  std::vector<ValidationResult> results( requests.size() );
+
+  QThreadPool threadPool;
+  threadPool.setMaxThreadCount( QThread::idealThreadCount() );
+  for ( std::size_t i = 0; i < requests.size(); ++i )
+    threadPool.start( new ValidationTask( requests[i], results[i] ) );
+  threadPool.waitForDone();
+
+  return results;
+}
+
 Style Style::fromFile(
-  const std::string &filePath, const SvgResolverCallback &svgResolverCallback /* = nullptr */,
+  const std::string &filePath, const SvgResolver &svgResolver /* = nullptr */,
   LayerGeometryType layerGeometryType /* = LayerGeometryType::Unknown */,
   DataType layerType /* = DataType::Unknown */, StyleFormat format /* = StyleFormat::QML */
 )
@@ -220,7 +557,7 @@ Style Style::fromFile(
     data = std::string( byteArray.constData(), byteArray.length() );
   }
 
-  return Style::fromString( data, svgResolverCallback, layerGeometryType, layerType, format );
+  return Style::fromString( data, svgResolver, layerGeometryType, layerType, format );
 }
 
 Style Style::fromDefaults(
@@ -233,175 +570,218 @@ Style Style::fromDefaults(
   return style;
 }
 
-QgsVectorLayerPtr Style::createTemporaryVectorLayerWithStyle( QString &errorMessage ) const
+QgsMapLayerPtr Style::createTemporaryLayerWithStyle(
+  const QDomDocument &styleData, QString &errorMessage
+) const
 {
-  if ( !mCachedTemporaryLayer )
+  QgsMapLayerPtr qgsMapLayer;
+  if ( mType == DataType::Raster )
+    qgsMapLayer = createTemporaryRasterLayer();
+  else
   {
     QgsVectorLayer::LayerOptions layerOptions;
-    QDomDocument styleData = mData;
-
-    QDomElement myRoot = styleData.firstChildElement( TAGS::QGIS );
-    if ( !myRoot.isNull() )
-    {
-      switch ( static_cast<Qgis::GeometryType>(
-        myRoot.firstChildElement( TAGS::LAYER_GEOMETRY_TYPE ).text().toInt()
-      ) )
-      {
-        case Qgis::GeometryType::Point:
-          layerOptions.fallbackWkbType = Qgis::WkbType::Point;
-          break;
-        case Qgis::GeometryType::Line:
-          layerOptions.fallbackWkbType = Qgis::WkbType::LineString;
-          break;
-        case Qgis::GeometryType::Polygon:
-          layerOptions.fallbackWkbType = Qgis::WkbType::Polygon;
-          break;
-        case Qgis::GeometryType::Unknown:
-          layerOptions.fallbackWkbType = Qgis::WkbType::Unknown;
-          break;
-        case Qgis::GeometryType::Null:
-          layerOptions.fallbackWkbType = Qgis::WkbType::NoGeometry;
-          break;
-      }
-    }
-    else
-    {
-      layerOptions.fallbackWkbType = Qgis::WkbType::Point;
-    }
-
-    QgsMapLayerPtr qgsVectorLayer = createTemporaryVectorLayer( layerOptions );
-    if ( !importToLayer( qgsVectorLayer, styleData, errorMessage ) )
-      return nullptr;
-
-    mCachedTemporaryLayer = qgsVectorLayer;
+    layerOptions.fallbackWkbType = styleWkbType( styleData );
+    qgsMapLayer = createTemporaryVectorLayer( layerOptions );
   }
-  return std::dynamic_pointer_cast<QgsVectorLayer>( mCachedTemporaryLayer );
-}
-
-QgsRasterLayerPtr Style::createTemporaryRasterLayerWithStyle( QString &errorMessage ) const
-{
-  if ( !mCachedTemporaryLayer )
-  {
-    QgsMapLayerPtr qgsRasterLayer = createTemporaryRasterLayer();
 
-    QDomDocument styleData = mData;
-    if ( !importToLayer( qgsRasterLayer, styleData, errorMessage ) )
-      return nullptr;
+  if ( !importToLayer( qgsMapLayer, styleData, errorMessage ) )
+    return nullptr;
 
-    mCachedTemporaryLayer = qgsRasterLayer;
-  }
-  return std::dynamic_pointer_cast<QgsRasterLayer>( mCachedTemporaryLayer );
+  return qgsMapLayer;
 }
 
-QgsMapLayerPtr Style::createTemporaryLayerWithStyleByType( const DataType type, QString &errorMessage ) const
+QgsMapLayerPtr Style::createTemporaryLayerWithStyle( QString &errorMessage ) const
 {
-  if ( type == DataType::Raster )
-    return createTemporaryRasterLayerWithStyle( errorMessage );
-  else
-    return createTemporaryVectorLayerWithStyle( errorMessage );
+  QDomDocument styleData;
+  styleData.setContent( mCompiledStyle );
+  return createTemporaryLayerWithStyle( styleData, errorMessage );
 }
 
 void Style::init( const CreateParams &params )
 {
-  mData.setContent( params.data );
+  QDomDocument styleData;
+  styleData.setContent( params.data );
+  mType = styleDataType( styleData );
 
-  if ( !validateGeometryType( params.layerGeometry ) )
+  if ( !validateGeometryType( styleData, params.layerGeometry ) )
     throw StyleTypeMismatch( ErrorString::StyleMismatch );
 
+  // The style is imported only once: validation, SVG paths resolution and reading
+  // of properties are done on the same temporary layer, which is released afterwards
   QString errorMessage;
-  if ( !validateStyle( errorMessage ) )
+  QgsMapLayerPtr qgsMapLayer = createTemporaryLayerWithStyle( styleData, errorMessage );
+  if ( !qgsMapLayer )
     throw StyleValidationError( errorMessage );
 
-  if ( params.layerType != DataType::Unknown && type() != params.layerType )
+  if ( params.layerType != DataType::Unknown && mType != params.layerType )
     throw StyleTypeMismatch( ErrorString::LayerStyleMismatch );
 
-  if ( params.callback || type() == DataType::Vector )
+  if ( mType == DataType::Vector )
   {
-    mData = resolveSvgPaths( params.callback );
-    mCachedTemporaryLayer.reset();
+    QgsVectorLayerPtr qgsVectorLayer = std::static_pointer_cast<QgsVectorLayer>( qgsMapLayer );
+    if ( params.svgResolver )
+      resolveSvgPaths( qgsVectorLayer, params.svgResolver );
+
+    mUsedAttributes = readUsedAttributes( qgsVectorLayer );
+    mNeedsSourceFeatures = usesSourceFeatures( qgsVectorLayer.get() );
   }
+
+  if ( qgsMapLayer->hasScaleBasedVisibility() )
+    mScaleRange = { qgsMapLayer->minimumScale(), qgsMapLayer->maximumScale() };
+
+  mCompiledStyle = compileStyle( qgsMapLayer.get(), hasGeometryType( styleData ) );
+  mStyleName = styleName( mCompiledStyle );
 }
 
 void Style::init( const DefaultStyleParams &params )
 {
   mDefault = true;
   mDefaultStyleParams = params;
+  mUsedAttributes = std::make_pair( true, std::set<std::string>() );
+}
+
+QString Style::name() const
+{
+  return mStyleName;
 }
 
 DataType Style::type() const
 {
-  if ( mType == DataType::Unknown && !mData.isNull() )
+  return mType;
+}
+
+UsedAttributes Style::usedAttributes() const
+{
+  // Raster styles use no attributes
+  if ( !mUsedAttributes )
+    return std::make_pair( true, std::set<std::string>() );
+  return *mUsedAttributes;
+}
+
+ScaleRange Style::scaleRange() const
+{
+  return mScaleRange;
+}
+
+bool Style::needsSourceFeatures() const
+{
+  return mNeedsSourceFeatures;
+}
+
+std::size_t Style::memoryUsage() const
+{
+  std::size_t size = sizeof( Style );
+  size += static_cast<std::size_t>( mCompiledStyle.capacity() ) * sizeof( QChar );
+  size += static_cast<std::size_t>( mStyleName.capacity() ) * sizeof( QChar );
+
+  if ( mUsedAttributes )
   {
-    bool isRaster = false;
-    QDomElement root = mData.firstChildElement( TAGS::QGIS );
+    for ( const std::string &attribute : mUsedAttributes->second )
+      size += sizeof( attribute ) + attribute.capacity();
+  }
 
-    QDomNode pipeNode = root.firstChildElement( TAGS::PIPE );
-    if ( pipeNode.isNull() )
-    {
-      // old project
-      pipeNode = root;
-    }
-    else
+  return size;
+}
+
+Style Style::withMemoizedExpressions() const
+{
+  if ( isDefaultStyle() || type() != DataType::Vector )
+    return *this;
+
+  QString errorMessage;
+  QgsVectorLayerPtr qgsVectorLayer = std::dynamic_pointer_cast<QgsVectorLayer>(
+    createTemporaryLayerWithStyle( errorMessage )
+  );
+  if ( !qgsVectorLayer )
+    throw QgisHeadlessError( errorMessage );
+
+  if ( QgsFeatureRenderer *renderer = qgsVectorLayer->renderer() )
+  {
+    QgsRenderContext renderContext;
+    for ( QgsSymbol *symbol : renderer->symbols( renderContext ) )
+      memoizeSymbol( symbol );
+
+    if ( renderer->type() == QLatin1String( "RuleRenderer" ) )
     {
-      QDomNode providerNode = pipeNode.firstChildElement( TAGS::PROVIDER );
-      if ( !providerNode.isNull() )
+      auto ruleBasedRenderer = static_cast<QgsRuleBasedRenderer *>( renderer );
+      for ( QgsRuleBasedRenderer::Rule *rule : ruleBasedRenderer->rootRule()->descendants() )
       {
-        QDomNode resamplingNode = providerNode.firstChildElement( TAGS::RESAMPLING );
-        isRaster = !resamplingNode.isNull();
+        if ( !rule->isElse() && !rule->filterExpression().isEmpty() )
+          rule->setFilterExpression(
+            ExpressionCache::memoizedExpression( rule->filterExpression() )
+          );
       }
     }
+  }
 
-    if ( !isRaster )
-    {
-      QDomElement rendererElement;
-      //rasterlayerproperties element there -> old format (1.8 and early 1.9)
-      if ( !root.firstChildElement( TAGS::RASTER_PROPERTIES ).isNull() )
-        rendererElement = root.firstChildElement( TAGS::RASTER_RENDERER );
-      else
-        rendererElement = pipeNode.firstChildElement( TAGS::RASTER_RENDERER );
-
-      isRaster = !rendererElement.isNull();
-    }
+  if ( QgsAbstractVectorLayerLabeling *labeling = qgsVectorLayer->labeling() )
+    memoizeLabeling( labeling );
 
-    mType = isRaster ? DataType::Raster : DataType::Vector;
-  }
+  QDomDocument styleData;
+  styleData.setContent( mCompiledStyle );
 
-  return mType;
+  Style style = *this;
+  style.mCompiledStyle = compileStyle( qgsVectorLayer.get(), hasGeometryType( styleData ) );
+  style.mStyleName = styleName( style.mCompiledStyle );
+  return style;
 }
 
-UsedAttributes Style::usedAttributes() const
+double Style::maxBleed( int dpi, int maxLabelLength /* = 64 */ ) const
 {
-  if ( !mUsedAttributesCached )
+  QgsRenderContext renderContext;
+  renderContext.setScaleFactor( dpi / 25.4 );
+
+  if ( isDefaultStyle() )
   {
-    mUsedAttributesCache = readUsedAttributes();
-    mUsedAttributesCached = true;
+    // Default marker is the largest one among default symbols
+    std::unique_ptr<QgsSymbol> symbol( QgsSymbol::defaultSymbol( Qgis::GeometryType::Point ) );
+    return QgsSymbolLayerUtils::estimateMaxSymbolBleed( symbol.get(), renderContext );
   }
-  return mUsedAttributesCache;
-}
 
-ScaleRange Style::scaleRange() const
-{
-  if ( mScaleRange[0] == -1 )
+  if ( type() != DataType::Vector )
+    return 0;
+
+  QString errorMessage;
+  QgsVectorLayerPtr qgsVectorLayer = std::dynamic_pointer_cast<QgsVectorLayer>(
+    createTemporaryLayerWithStyle( errorMessage )
+  );
+  if ( !qgsVectorLayer )
+    throw QgisHeadlessError( errorMessage );
+
+  double bleed = 0;
+  if ( QgsFeatureRenderer *renderer = qgsVectorLayer->renderer() )
   {
-    if ( isDefaultStyle() )
-      mScaleRange[0] = -2;
-    else
+    for ( QgsSymbol *symbol : renderer->symbols( renderContext ) )
+      bleed = std::max( bleed, QgsSymbolLayerUtils::estimateMaxSymbolBleed( symbol, renderContext ) );
+  }
+
+  if ( QgsAbstractVectorLayerLabeling *labeling = qgsVectorLayer->labeling() )
+  {
+    for ( const QString &providerId : labeling->subProviders() )
     {
-      QString errorMessage;
-      QgsMapLayerPtr qgsMapLayer = createTemporaryLayerWithStyleByType( type(), errorMessage );
-      if ( !qgsMapLayer )
-        throw QgisHeadlessError( errorMessage );
+      const QgsPalLayerSettings settings = labeling->settings( providerId );
+      if ( !settings.drawLabels )
+        continue;
+
+      // Labels may be placed on either side of the feature, so their whole width is added
+      const QgsTextFormat format = settings.format();
+      double labelBleed = std::max( maxLabelLength, 1 )
+                          * renderContext.convertToPainterUnits(
+                            format.size(), format.sizeUnit(), format.sizeMapUnitScale()
+                          );
+      if ( format.buffer().enabled() )
+        labelBleed += renderContext.convertToPainterUnits(
+          format.buffer().size(), format.buffer().sizeUnit(), format.buffer().sizeMapUnitScale()
+        );
+      labelBleed += renderContext.convertToPainterUnits(
+        settings.dist, settings.distUnits, settings.distMapUnitScale
+      );
 
-      if ( !qgsMapLayer->hasScaleBasedVisibility() )
-        mScaleRange[0] = -2;
-      else
-      {
-        mScaleRange[0] = qgsMapLayer->minimumScale();
-        mScaleRange[1] = qgsMapLayer->maximumScale();
-      }
+      bleed = std::max( bleed, labelBleed );
     }
   }
-  return mScaleRange;
+
+  return bleed;
 }
 
 bool Style::isDefaultStyle() const
@@ -409,53 +789,68 @@ bool Style::isDefaultStyle() const
   return mDefault;
 }
 
-bool Style::validateGeometryType( LayerGeometryType layerGeometryType ) const
+bool Style::validateGeometryType(
+  const QDomDocument &styleData, LayerGeometryType layerGeometryType
+) const
 {
-  QDomElement geometryTypeElement = mData.firstChildElement( TAGS::QGIS )
+  QDomElement geometryTypeElement = styleData.firstChildElement( TAGS::QGIS )
                                       .firstChildElement( TAGS::LAYER_GEOMETRY_TYPE );
   if ( layerGeometryType == LayerGeometryType::Unknown || geometryTypeElement.isNull() )
     return true;
 
-  QgsVectorLayer::LayerOptions layerOptions;
-  layerOptions.fallbackWkbType = layerGeometryTypeToQgsWkbType( layerGeometryType );
-  QgsVectorLayerPtr qgsVectorLayer = std::dynamic_pointer_cast<QgsVectorLayer>(
-    createTemporaryVectorLayer( layerOptions )
+  const Qgis::GeometryType geometryType = QgsWkbTypes::geometryType(
+    layerGeometryTypeToQgsWkbType( layerGeometryType )
   );
-  Qgis::GeometryType importLayerGeometryType = static_cast<Qgis::GeometryType>(
+  const Qgis::GeometryType importLayerGeometryType = static_cast<Qgis::GeometryType>(
     geometryTypeElement.text().toInt()
   );
-  return ( qgsVectorLayer->geometryType() == importLayerGeometryType ? true : false );
-}
-
-bool Style::validateStyle( QString &errorMessage ) const
-{
-  return createTemporaryLayerWithStyleByType( type(), errorMessage ) ? true : false;
+  return geometryType == importLayerGeometryType;
 }
 
 bool Style::importToLayer( QgsMapLayerPtr &layer, QString &errorMessage ) const
 {
-  if ( mCachedTemporaryLayer && mCachedTemporaryLayer->type() == layer->type()
-       && !mCachedTemporaryLayer->styleManager()->styles().empty() )
+  if ( mCompiledStyle.isEmpty() )
   {
-    const QString currentStyleName = mCachedTemporaryLayer->styleManager()->currentStyle();
-    const QgsMapLayerStyle currentStyle = mCachedTemporaryLayer->styleManager()->style(
-      currentStyleName
-    );
-    const QString styleName = "StyleName_"
-                              + QString::number( layer->styleManager()->styles().size() );
+    errorMessage = ErrorString::AddStyleFailed;
+    return false;
+  }
 
-    layer->styleManager()->addStyle( styleName, currentStyle );
-    bool result = layer->styleManager()->setCurrentStyle( styleName );
-    if ( !result )
-    {
-      errorMessage = ErrorString::AddStyleFailed;
-    }
-    return result;
+  // Layer's state may differ from the registered style, e.g. after MapRequest::applyRenderSymbols()
+  // or Layer::setRendererSymbolColor(), so the compiled style is always applied again
+  QgsMapLayerStyleManager *styleManager = layer->styleManager();
+  if ( styleManager->currentStyle() == mStyleName )
+  {
+    // Switching to the current style does nothing
+    QgsMapLayerStyle( mCompiledStyle ).writeToLayer( layer.get() );
+    return true;
   }
+
+  // The manager saves the layer's state into the entry of a style, when it stops being current
+  if ( styleManager->styles().contains( mStyleName ) )
+    styleManager->removeStyle( mStyleName );
   else
+    collectLayerStyles( styleManager );
+
+  bool result = styleManager->addStyle( mStyleName, QgsMapLayerStyle( mCompiledStyle ) )
+                && styleManager->setCurrentStyle( mStyleName );
+  if ( !result )
   {
-    return importToLayer( layer, mData, errorMessage );
+    errorMessage = ErrorString::AddStyleFailed;
   }
+  return result;
+}
+
+void Style::collectLayerStyles( QgsMapLayerStyleManager *styleManager ) const
+{
+  QStringList names = styleManager->styles().filter( QRegularExpression( "^" + StyleNamePrefix ) );
+  if ( names.size() < MaxLayerStyles )
+    return;
+
+  // The current style can't be removed, the rest are dropped at once as
+  // the style manager doesn't track which styles were used recently
+  names.removeOne( styleManager->currentStyle() );
+  for ( const QString &name : names )
+    styleManager->removeStyle( name );
 }
 
 bool Style::importToLayer( QgsMapLayerPtr &layer, QDomDocument styleData, QString &errorMessage ) const
@@ -464,22 +859,10 @@ bool Style::importToLayer( QgsMapLayerPtr &layer, QDomDocument styleData, QStrin
     ->importNamedStyle( styleData, errorMessage, static_cast<QgsMapLayer::StyleCategory>( Style::DefaultImportCategories ) );
 }
 
-UsedAttributes Style::readUsedAttributes() const
+UsedAttributes Style::readUsedAttributes( const QgsVectorLayerPtr &qgsVectorLayer ) const
 {
   std::set<std::string> usedAttributes;
 
-  if ( isDefaultStyle() )
-  {
-    return std::make_pair( true, usedAttributes );
-  }
-
-  QString errorMessage;
-  QgsVectorLayerPtr qgsVectorLayer = createTemporaryVectorLayerWithStyle( errorMessage );
-  if ( !qgsVectorLayer )
-  {
-    throw QgisHeadlessError( errorMessage );
-  }
-
   if ( qgsVectorLayer->diagramsEnabled() )
   {
     const QgsDiagramRenderer *diagramRenderer = qgsVectorLayer->diagramRenderer();
@@ -558,35 +941,47 @@ UsedAttributes Style::readUsedAttributes() const
   return std::make_pair( true, std::move( usedAttributes ) );
 }
 
-QDomDocument Style::resolveSvgPaths( const SvgResolverCallback &svgResolverCallback ) const
+void Style::resolveSvgPaths(
+  const QgsVectorLayerPtr &qgsVectorLayer, const SvgResolver &svgResolver
+) const
 {
-  QDomDocument exportedStyle;
-  QString errorMessage;
+  QgsRenderContext renderContext;
+  const QgsSymbolList symbols = qgsVectorLayer->renderer()->symbols( renderContext );
+  QgsAbstractVectorLayerLabeling *labeling = qgsVectorLayer->labeling();
 
-  QgsVectorLayerPtr qgsVectorLayer = createTemporaryVectorLayerWithStyle( errorMessage );
-  if ( !qgsVectorLayer )
-    throw QgisHeadlessError( errorMessage );
+  // Paths are collected first, so the resolver is called once per distinct path
+  QStringList paths;
+  for ( QgsSymbol *symbol : symbols )
+    collectSymbolSvgPaths( symbol, paths );
+  if ( labeling )
+    collectLabelingSvgPaths( labeling, paths );
 
-  QgsRenderContext renderContext;
-  for ( QgsSymbol *symbol : qgsVectorLayer->renderer()->symbols( renderContext ) )
-  {
-    resolveSymbol( symbol, svgResolverCallback );
-  }
+  if ( paths.isEmpty() )
+    return;
+
+  std::vector<std::string> pathList;
+  pathList.reserve( paths.size() );
+  for ( const QString &path : paths )
+    pathList.push_back( path.toStdString() );
 
-  if ( auto &&labeling = qgsVectorLayer->labeling() )
+  const std::vector<std::string> resolvedList = svgResolver.resolve( pathList );
+
+  ResolvedPaths resolvedPaths;
+  for ( int i = 0; i < paths.size(); ++i )
   {
-    resolveLabelingSvgPaths( labeling, svgResolverCallback );
+    const QString resolved = QString::fromStdString( resolvedList[i] );
+    if ( resolved != paths[i] )
+      resolvedPaths.insert( paths[i], resolved );
   }
 
-  qgsVectorLayer->exportNamedStyle( exportedStyle, errorMessage );
-  if ( !errorMessage.isEmpty() )
-    throw QgisHeadlessError( errorMessage );
+  if ( resolvedPaths.isEmpty() )
+    return;
 
-  QDomElement myRoot = mData.firstChildElement( TAGS::QGIS );
-  if ( myRoot.isNull() || myRoot.firstChildElement( TAGS::LAYER_GEOMETRY_TYPE ).text().isEmpty() )
-    removeLayerGeometryTypeElement( exportedStyle );
+  for ( QgsSymbol *symbol : symbols )
+    resolveSymbol( symbol, resolvedPaths );
 
-  return exportedStyle;
+  if ( labeling )
+    resolveLabelingSvgPaths( labeling, resolvedPaths );
 }
 
 QSet<QString> Style::referencedFields(
@@ -620,17 +1015,6 @@ QSet<QString> Style::referencedFields(
   return referenced;
 }
 
-void Style::removeLayerGeometryTypeElement( QDomDocument &domDocument ) const
-{
-  QDomElement root = domDocument.firstChildElement( TAGS::QGIS );
-  if ( !root.isNull() )
-  {
-    QDomElement child = root.firstChildElement( TAGS::LAYER_GEOMETRY_TYPE );
-    if ( !child.isNull() )
-      root.removeChild( child );
-  }
-}
-
 QString Style::exportToString( const StyleFormat format ) const
 {
   QgsMapLayerPtr qgsMapLayer;
@@ -700,7 +1084,7 @@ QString Style::exportToString( const StyleFormat format ) const
   }
   else
   {
-    qgsMapLayer = createTemporaryLayerWithStyleByType( type(), errorMessage );
+    qgsMapLayer = createTemporaryLayerWithStyle( errorMessage );
     if ( !qgsMapLayer )
       throw QgisHeadlessError( errorMessage );
   }
@@ -720,14 +1104,9 @@ QString Style::exportToString( const StyleFormat format ) const
   return exportedStyle.toString();
 }
 
-const QDomDocument &Style::data() const
-{
-  return mData;
-}
-
-QDomDocument &Style::data()
+QString Style::data() const
 {
-  return mData;
+  return mCompiledStyle;
 }
 
 QColor Style::defaultStyleColor() const
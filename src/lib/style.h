@@ -24,14 +24,18 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <vector>
 #include <QString>
 #include <QColor>
 #include <QDomDocument>
 
+#include "svg_resolver.h"
 #include "types.h"
 
 class QDomDocument;
 class QgsAbstractVectorLayerLabeling;
+class QgsMapLayerStyleManager;
 class QgsVectorLayer;
 class QgsRasterLayer;
 class QgsSymbol;
@@ -39,7 +43,8 @@ class QgsRenderContext;
 
 namespace HeadlessRender
 {
-  typedef std::function<std::string( const std::string & )> SvgResolverCallback;
+  class SymbolCache;
+
   typedef std::shared_ptr<QgsVectorLayer> QgsVectorLayerPtr;
   typedef std::shared_ptr<QgsRasterLayer> QgsRasterLayerPtr;
 
@@ -54,15 +59,39 @@ namespace HeadlessRender
        */
       static const StyleCategory DefaultImportCategories;
 
+      /**
+       * Style to be validated with validateMany().
+       */
+      struct ValidationRequest
+      {
+          std::string data;
+          LayerGeometryType layerGeometryType = LayerGeometryType::Unknown;
+          DataType layerType = DataType::Unknown;
+          StyleFormat format = StyleFormat::QML;
+      };
+
+      /**
+       * Result of validation of a single style with validateMany().
+       */
+      struct ValidationResult
+      {
+          bool valid = false;
+          std::string error; // empty if style is valid
+          // std::nullopt for invalid and raster styles
+          std::optional<UsedAttributes> usedAttributes;
+          ScaleRange scaleRange = { -2, 0 }; // "-2" - has no scale range
+      };
+
       /**
        * Creates Style from QML or SLD formatted string.
        * \param string string, containing description of style.
+       * \param svgResolver resolver of SVG paths, referenced by style.
        * \param layerGeometryType type of vector layer's geometry.
        * \param layerType type of layer: raster or vector.
        * \param format format of string, containing descripton of style.
        */
       static Style fromString(
-        const std::string &string, const SvgResolverCallback &svgResolverCallback = nullptr,
+        const std::string &string, const SvgResolver &svgResolver = nullptr,
         LayerGeometryType layerGeometryType = LayerGeometryType::Unknown,
         DataType layerType = DataType::Unknown, StyleFormat format = StyleFormat::QML
       );
@@ -70,12 +99,13 @@ namespace HeadlessRender
       /**
        * Creates Style from QML or SLD file.
        * \param filePath path to file, containing description of style.
+       * \param svgResolver resolver of SVG paths, referenced by style.
        * \param layerGeometryType type of vector layer's geometry.
        * \param layerType type of layer: raster or vector.
        * \param format format of file, containing descripton of style.
        */
       static Style fromFile(
-        const std::string &filePath, const SvgResolverCallback &svgResolverCallback = nullptr,
+        const std::string &filePath, const SvgResolver &svgResolver = nullptr,
         LayerGeometryType layerGeometryType = LayerGeometryType::Unknown,
         DataType layerType = DataType::Unknown, StyleFormat format = StyleFormat::QML
       );
@@ -93,14 +123,19 @@ namespace HeadlessRender
       );
 
       /**
-       * Returns XML representation of style.
+       * Validates styles in parallel on a thread pool, the same way fromString() does.
+       * Styles are validated without SVG resolver.
+       * \param requests styles to validate.
+       * \returns results of validation in the order of requests.
        */
-      const QDomDocument &data() const;
+      static std::vector<ValidationResult> validateMany(
+        const std::vector<ValidationRequest> &requests
+      );
 
       /**
-       * Provides access to XML representation of style.
+       * Returns XML representation of style, as it is applied to layers.
        */
-      QDomDocument &data();
+      QString data() const;
 
       /**
        * Returns set of attributes, used in style.
@@ -112,6 +147,41 @@ namespace HeadlessRender
        */
       ScaleRange scaleRange() const;
 
+      /**
+       * Returns true, if expressions of the style use geometries, like $area or $x, or feature
+       * ids, so features must be rendered from the layer itself rather than from its copies with
+       * reprojected geometries and other ids.
+       * \sa Layer::setReprojectionCache()
+       */
+      bool needsSourceFeatures() const;
+
+      /**
+       * Returns estimated maximum distance in pixels, by which symbols and labels extend beyond
+       * features' geometries. Each character of a label is assumed to be as wide as the font size.
+       * \param dpi resolution of output image.
+       * \param maxLabelLength maximum number of characters in labels' texts.
+       */
+      double maxBleed( int dpi, int maxLabelLength = 64 ) const;
+
+      /**
+       * Returns copy of the style, in which expressions of data-defined properties, labels and
+       * rule filters are memoized by ExpressionCache, if they depend on attributes only.
+       * Raster and default styles are returned as is.
+       */
+      Style withMemoizedExpressions() const;
+
+      /**
+       * Returns approximate number of bytes, occupied by style.
+       */
+      std::size_t memoryUsage() const;
+
+      /**
+       * Returns name, under which the style is registered in layers' style managers.
+       * It is derived from the style's content, so equal styles have equal names.
+       * Default styles have empty names.
+       */
+      QString name() const;
+
       /**
        * Returns type of layer's data.
        */
@@ -143,10 +213,12 @@ namespace HeadlessRender
       bool importToLayer( QgsMapLayerPtr &layer, QString &errorMessage ) const;
 
     private:
+      friend class SymbolCache;
+
       struct CreateParams
       {
           QString data;
-          SvgResolverCallback callback;
+          SvgResolver svgResolver;
           LayerGeometryType layerGeometry;
           DataType layerType;
       };
@@ -164,33 +236,42 @@ namespace HeadlessRender
       void init( const DefaultStyleParams &params );
 
       bool importToLayer( QgsMapLayerPtr &layer, QDomDocument style, QString &errorMessage ) const;
-      bool validateGeometryType( LayerGeometryType layerGeometryType ) const;
-      bool validateStyle( QString &errorMessage ) const;
-      void removeLayerGeometryTypeElement( QDomDocument & ) const;
+      bool validateGeometryType(
+        const QDomDocument &styleData, LayerGeometryType layerGeometryType
+      ) const;
+      void collectLayerStyles( QgsMapLayerStyleManager *styleManager ) const;
 
-      QDomDocument resolveSvgPaths( const SvgResolverCallback &svgResolverCallback ) const;
+      void resolveSvgPaths(
+        const QgsVectorLayerPtr &qgsVectorLayer, const SvgResolver &svgResolver
+      ) const;
 
-      QgsVectorLayerPtr createTemporaryVectorLayerWithStyle( QString &errorMessage ) const;
-      QgsRasterLayerPtr createTemporaryRasterLayerWithStyle( QString &errorMessage ) const;
-      QgsMapLayerPtr createTemporaryLayerWithStyleByType( DataType type, QString &errorMessage ) const;
+      QgsMapLayerPtr createTemporaryLayerWithStyle(
+        const QDomDocument &styleData, QString &errorMessage
+      ) const;
+      QgsMapLayerPtr createTemporaryLayerWithStyle( QString &errorMessage ) const;
       QSet<QString> referencedFields(
         const QgsVectorLayerPtr &layer, const QgsRenderContext &context, const QString &providerId
       ) const;
-      UsedAttributes readUsedAttributes() const;
+      UsedAttributes readUsedAttributes( const QgsVectorLayerPtr &qgsVectorLayer ) const;
+
+      // XML of the style as exported from a layer, heavy objects (layers, renderers, labeling)
+      // are created from it on demand and released after use
+      QString mCompiledStyle;
 
-      QDomDocument mData;
+      // Name under which the style is registered in layers' style managers, derived from the
+      // hash of mCompiledStyle, so that applying the same style again reuses the registered one
+      QString mStyleName;
 
       bool mDefault = false;
       DefaultStyleParams mDefaultStyleParams;
 
-      mutable DataType mType = DataType::Unknown;
+      DataType mType = DataType::Unknown;
 
-      mutable UsedAttributes mUsedAttributesCache;
-      mutable bool mUsedAttributesCached = false;
+      std::optional<UsedAttributes> mUsedAttributes; // std::nullopt for raster styles
 
-      mutable ScaleRange mScaleRange = { -1, 0 }; // "-1" - not cached; "-2" has no scale range
+      ScaleRange mScaleRange = { -2, 0 }; // "-2" - has no scale range
 
-      mutable QgsMapLayerPtr mCachedTemporaryLayer;
+      bool mNeedsSourceFeatures = false;
   };
 } //namespace HeadlessRender
 
@@ -0,0 +1,117 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "style_cache.h"
+#include "lru_cache.h"
+#include <QCryptographicHash>
+#include <QByteArray>
+
+#include <functional>
+#include <mutex>
+
+namespace
+{
+  const std::size_t DEFAULT_CAPACITY = 1024;
+
+  struct StyleKey
+  {
+      QByteArray hash;
+      HeadlessRender::ResolverIdentity resolver;
+      HeadlessRender::LayerGeometryType layerGeometryType;
+      HeadlessRender::DataType layerType;
+      HeadlessRender::StyleFormat format;
+
+      bool operator==( const StyleKey &other ) const
+      {
+        return hash == other.hash && resolver.get() == other.resolver.get()
+               && layerGeometryType == other.layerGeometryType && layerType == other.layerType
+               && format == other.format;
+      }
+  };
+
+  struct StyleKeyHash
+  {
+      std::size_t operator()( const StyleKey &key ) const
+      {
+        std::size_t seed = qHash( key.hash );
+        seed ^= std::hash<const void *>()( key.resolver.get() ) + 0x9e3779b9 + ( seed << 6 )
+                + ( seed >> 2 );
+        seed ^= static_cast<std::size_t>( key.layerGeometryType ) << 8;
+        seed ^= static_cast<std::size_t>( key.layerType ) << 16;
+        seed ^= static_cast<std::size_t>( key.format ) << 24;
+        return seed;
+      }
+  };
+
+  typedef HeadlessRender::LruCache<StyleKey, HeadlessRender::Style, StyleKeyHash> Cache;
+
+  std::mutex cacheMutex;
+  Cache cache( DEFAULT_CAPACITY );
+} // namespace
+
+HeadlessRender::Style HeadlessRender::StyleCache::fromString(
+  const std::string &string, const SvgResolver &svgResolver /* = nullptr */,
+  LayerGeometryType layerGeometryType /* = LayerGeometryType::Unknown */,
+  DataType layerType /* = DataType::Unknown */, StyleFormat format /* = StyleFormat::QML */
+)
+{
+  // Results of anonymous resolvers can't be told apart, so they are not cached
+  if ( svgResolver && !svgResolver.identity() )
+    return Style::fromString( string, svgResolver, layerGeometryType, layerType, format );
+
+  const QByteArray content = QByteArray::fromRawData( string.data(), static_cast<int>( string.size() ) );
+  const StyleKey key {
+    QCryptographicHash::hash( content, QCryptographicHash::Sha1 ),
+    svgResolver ? svgResolver.identity() : nullptr, layerGeometryType, layerType, format
+  };
+
+  {
+    std::lock_guard<std::mutex> lock( cacheMutex );
+    if ( std::optional<Style> style = cache.get( key ) )
+      return *style;
+  }
+
+  // Style is built outside of the lock, so slow SVG resolvers do not block other requests
+  const Style style
+    = Style::fromString( string, svgResolver, layerGeometryType, layerType, format );
+
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.put( key, style );
+  return style;
+}
+
+void HeadlessRender::StyleCache::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.setCapacity( capacity );
+}
+
+HeadlessRender::CacheStats HeadlessRender::StyleCache::stats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return cache.stats();
+}
+
+void HeadlessRender::StyleCache::clear()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.clear();
+  cache.resetStats();
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_STYLE_CACHE_H
+#define QGIS_HEADLESS_STYLE_CACHE_H
+
+#include <memory>
+#include <string>
+#include "style.h"
+#include "types.h"
+
+namespace HeadlessRender
+{
+  /**
+   * Process-wide thread-safe cache of ready to apply styles, keyed by content hash, SVG resolver
+   * identity, layer geometry type, layer type and format.
+   * Styles returned by the cache share their content, so it must not be modified.
+   */
+  class QGIS_HEADLESS_EXPORT StyleCache
+  {
+    public:
+      /**
+       * Returns style from the cache, creating it with Style::fromString() on miss.
+       * \param string string, containing description of style.
+       * \param svgResolver resolver of SVG paths, styles are not cached if it has no identity.
+       * \param layerGeometryType type of vector layer's geometry.
+       * \param layerType type of layer: raster or vector.
+       * \param format format of string, containing descripton of style.
+       */
+      static Style fromString(
+        const std::string &string, const SvgResolver &svgResolver = nullptr,
+        LayerGeometryType layerGeometryType = LayerGeometryType::Unknown,
+        DataType layerType = DataType::Unknown, StyleFormat format = StyleFormat::QML
+      );
+
+      /**
+       * Sets maximum number of cached styles, least recently used styles are evicted.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns hit, miss and eviction counters of the cache.
+       */
+      static CacheStats stats();
+
+      /**
+       * Removes all styles from the cache and resets statistics.
+       */
+      static void clear();
+
+    private:
+      StyleCache() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_STYLE_CACHE_H
@@ -0,0 +1,171 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "svg_resolver.h"
+#include "exceptions.h"
+#include "lru_cache.h"
+
+#include <mutex>
+
+namespace
+{
+  const std::size_t DEFAULT_CAPACITY = 4096;
+
+  struct PathKey
+  {
+      HeadlessRender::ResolverIdentity resolver;
+      std::string path;
+
+      bool operator==( const PathKey &other ) const
+      {
+        return resolver.get() == other.resolver.get() && path == other.path;
+      }
+  };
+
+  struct PathKeyHash
+  {
+      std::size_t operator()( const PathKey &key ) const
+      {
+        std::size_t seed = std::hash<std::string>()( key.path );
+        seed ^= std::hash<const void *>()( key.resolver.get() ) + 0x9e3779b9 + ( seed << 6 )
+                + ( seed >> 2 );
+        return seed;
+      }
+  };
+
+  typedef HeadlessRender::LruCache<PathKey, std::string, PathKeyHash> Cache;
+
+  std::mutex cacheMutex;
+  Cache cache( DEFAULT_CAPACITY );
+} // namespace
+
+HeadlessRender::SvgResolver::SvgResolver(
+  const SvgResolverCallback &callback, const ResolverIdentity &identity /* = nullptr */
+)
+  : mIdentity( identity )
+{
+  if ( callback )
+  {
+    mCallback = [callback]( const std::vector<std::string> &paths ) {
+      std::vector<std::string> resolved;
+      resolved.reserve( paths.size() );
+      for ( const std::string &path : paths )
+        resolved.push_back( callback( path ) );
+      return resolved;
+    };
+  }
+}
+
+HeadlessRender::SvgResolver HeadlessRender::SvgResolver::fromBatch(
+  const SvgBatchResolverCallback &callback, const ResolverIdentity &identity /* = nullptr */
+)
+{
+  SvgResolver resolver;
+  resolver.mCallback = callback;
+  resolver.mIdentity = identity;
+  return resolver;
+}
+
+HeadlessRender::SvgResolver::operator bool() const
+{
+  return static_cast<bool>( mCallback );
+}
+
+const HeadlessRender::ResolverIdentity &HeadlessRender::SvgResolver::identity() const
+{
+  return mIdentity;
+}
+
+std::vector<std::string> HeadlessRender::SvgResolver::resolve(
+  const std::vector<std::string> &paths
+) const
+{
+  if ( !mCallback || paths.empty() )
+    return paths;
+
+  std::vector<std::string> result( paths.size() );
+  std::vector<std::string> missing;
+  std::vector<std::size_t> missingIndexes;
+
+  {
+    std::unique_lock<std::mutex> lock( cacheMutex, std::defer_lock );
+    if ( mIdentity )
+      lock.lock();
+
+    for ( std::size_t i = 0; i < paths.size(); ++i )
+    {
+      std::optional<std::string> resolved;
+      if ( mIdentity )
+        resolved = cache.get( { mIdentity, paths[i] } );
+
+      if ( resolved )
+        result[i] = *resolved;
+      else
+      {
+        missing.push_back( paths[i] );
+        missingIndexes.push_back( i );
+      }
+    }
+  }
+
+  if ( missing.empty() )
+    return result;
+
+  // Callback is invoked outside of the lock, so slow resolvers do not block other styles
+  const std::vector<std::string> resolved = mCallback( missing );
+  if ( resolved.size() != missing.size() )
+    throw QgisHeadlessError(
+      QStringLiteral( "SVG resolver returned %1 paths, %2 expected" )
+        .arg( resolved.size() )
+        .arg( missing.size() )
+    );
+
+  std::unique_lock<std::mutex> lock( cacheMutex, std::defer_lock );
+  if ( mIdentity )
+    lock.lock();
+
+  for ( std::size_t i = 0; i < missing.size(); ++i )
+  {
+    result[missingIndexes[i]] = resolved[i];
+    if ( mIdentity )
+      cache.put( { mIdentity, missing[i] }, resolved[i] );
+  }
+
+  return result;
+}
+
+void HeadlessRender::SvgResolver::setCapacity( std::size_t capacity )
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.setCapacity( capacity );
+}
+
+HeadlessRender::CacheStats HeadlessRender::SvgResolver::stats()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  return cache.stats();
+}
+
+void HeadlessRender::SvgResolver::clear()
+{
+  std::lock_guard<std::mutex> lock( cacheMutex );
+  cache.clear();
+  cache.resetStats();
+}
@@ -0,0 +1,111 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_SVG_RESOLVER_H
+#define QGIS_HEADLESS_SVG_RESOLVER_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+
+namespace HeadlessRender
+{
+  typedef std::function<std::string( const std::string & )> SvgResolverCallback;
+
+  /**
+   * Callback resolving all SVG paths of a style at once, returns resolved paths in the same order.
+   */
+  typedef std::function<std::vector<std::string>( const std::vector<std::string> & )>
+    SvgBatchResolverCallback;
+
+  /**
+   * Identity of SVG resolver, the address of pointed object is compared. The object is kept alive
+   * while styles or paths resolved with it are cached.
+   */
+  typedef std::shared_ptr<const void> ResolverIdentity;
+
+  /**
+   * Resolves paths of SVG files referenced by styles with a user callback. Results of resolvers
+   * with identity are memoized in a process-wide thread-safe cache of limited size.
+   */
+  class QGIS_HEADLESS_EXPORT SvgResolver
+  {
+    public:
+      SvgResolver() = default;
+      SvgResolver( std::nullptr_t ) {}
+
+      /**
+       * Creates resolver calling \a callback for each distinct path.
+       * \param callback callback resolving single path.
+       * \param identity identity of the callback, paths are not memoized if it's nullptr.
+       */
+      SvgResolver(
+        const SvgResolverCallback &callback, const ResolverIdentity &identity = nullptr
+      );
+
+      /**
+       * Creates resolver calling \a callback once with all paths, which are not memoized yet.
+       * \param callback callback resolving list of paths.
+       * \param identity identity of the callback, paths are not memoized if it's nullptr.
+       */
+      static SvgResolver fromBatch(
+        const SvgBatchResolverCallback &callback, const ResolverIdentity &identity = nullptr
+      );
+
+      /**
+       * Returns true if resolver has a callback.
+       */
+      explicit operator bool() const;
+
+      /**
+       * Returns identity of the resolver's callback.
+       */
+      const ResolverIdentity &identity() const;
+
+      /**
+       * Resolves distinct paths, returns resolved paths in the same order.
+       */
+      std::vector<std::string> resolve( const std::vector<std::string> &paths ) const;
+
+      /**
+       * Sets maximum number of memoized paths, least recently used paths are evicted.
+       */
+      static void setCapacity( std::size_t capacity );
+
+      /**
+       * Returns hit, miss and eviction counters of memoized paths.
+       */
+      static CacheStats stats();
+
+      /**
+       * Removes all memoized paths and resets statistics.
+       */
+      static void clear();
+
+    private:
+      SvgBatchResolverCallback mCallback;
+      ResolverIdentity mIdentity;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_SVG_RESOLVER_H
@@ -0,0 +1,151 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "symbol_cache.h"
+#include "exceptions.h"
+
+#include <qgsapplication.h>
+#include <qgsmarkersymbol.h>
+#include <qgspallabeling.h>
+#include <qgsrendercontext.h>
+#include <qgsrenderer.h>
+#include <qgssvgcache.h>
+#include <qgssymbol.h>
+#include <qgssymbollayer.h>
+#include <qgssymbollayerutils.h>
+#include <qgstextformat.h>
+#include <qgsvectorlayer.h>
+#include <qgsvectorlayerlabeling.h>
+
+#include <QImage>
+#include <QPainter>
+
+namespace
+{
+  // Size of image, on which symbols are drawn at their map size
+  const int PREVIEW_SIZE = 64;
+
+  struct UsedCaches
+  {
+      bool svg = false;
+      bool image = false;
+  };
+
+  void collectUsedCaches( const QgsSymbol *symbol, UsedCaches &caches )
+  {
+    for ( QgsSymbolLayer *symbolLayer : symbol->symbolLayers() )
+    {
+      const QString layerType = symbolLayer->layerType();
+      if ( layerType == QLatin1String( "SvgMarker" ) || layerType == QLatin1String( "SVGFill" ) )
+        caches.svg = true;
+      else if ( layerType == QLatin1String( "RasterMarker" )
+                || layerType == QLatin1String( "RasterFill" ) )
+        caches.image = true;
+
+      if ( symbolLayer->subSymbol() )
+        collectUsedCaches( symbolLayer->subSymbol(), caches );
+    }
+  }
+
+  QgsRenderContext createRenderContext( QPainter *painter, int dpi )
+  {
+    QgsRenderContext renderContext = QgsRenderContext::fromQPainter( painter );
+    renderContext.setScaleFactor( dpi / 25.4 );
+    return renderContext;
+  }
+
+  void preloadSymbol( QgsSymbol *symbol, int dpi, const std::vector<int> &sizes )
+  {
+    UsedCaches caches;
+    collectUsedCaches( symbol, caches );
+    if ( !caches.svg && !caches.image )
+      return;
+
+    {
+      QImage image( PREVIEW_SIZE, PREVIEW_SIZE, QImage::Format_ARGB32_Premultiplied );
+      image.fill( Qt::transparent );
+      QPainter painter( &image );
+      QgsRenderContext renderContext = createRenderContext( &painter, dpi );
+      symbol->drawPreviewIcon( &painter, image.size(), &renderContext );
+    }
+
+    for ( int size : sizes )
+    {
+      QgsRenderContext renderContext = createRenderContext( nullptr, dpi );
+      QgsSymbolLayerUtils::symbolPreviewPixmap( symbol, QSize( size, size ), 0, &renderContext );
+    }
+  }
+
+  void preloadLabelingBackground( const QgsAbstractVectorLayerLabeling *labeling, int dpi )
+  {
+    const QgsTextBackgroundSettings background = labeling->settings().format().background();
+    if ( !background.enabled() )
+      return;
+
+    if ( background.type() == QgsTextBackgroundSettings::ShapeMarkerSymbol )
+    {
+      preloadSymbol( background.markerSymbol(), dpi, {} );
+    }
+    else if ( background.type() == QgsTextBackgroundSettings::ShapeSVG
+              && background.sizeType() == QgsTextBackgroundSettings::SizeFixed )
+    {
+      // Size of buffer-sized backgrounds depends on label text, so only fixed size is preloaded
+      QgsRenderContext renderContext = createRenderContext( nullptr, dpi );
+      const double size = renderContext.convertToPainterUnits(
+        background.size().width(), background.sizeUnit(), background.sizeMapUnitScale()
+      );
+      const double strokeWidth = renderContext.convertToPainterUnits(
+        background.strokeWidth(), background.strokeWidthUnit(),
+        background.strokeWidthMapUnitScale()
+      );
+      bool fitsInCache = true;
+      QgsApplication::svgCache()->svgAsImage(
+        background.svgFile(), size, background.fillColor(), background.strokeColor(),
+        strokeWidth, renderContext.scaleFactor(), fitsInCache
+      );
+    }
+  }
+} // namespace
+
+void HeadlessRender::SymbolCache::preload(
+  const Style &style, int dpi, const std::vector<int> &sizes /* = {} */
+)
+{
+  // Raster styles and default styles don't have SVG or raster image symbols
+  if ( style.isDefaultStyle() || style.type() != DataType::Vector )
+    return;
+
+  QString errorMessage;
+  QgsVectorLayerPtr qgsVectorLayer = std::dynamic_pointer_cast<QgsVectorLayer>(
+    style.createTemporaryLayerWithStyle( errorMessage )
+  );
+  if ( !qgsVectorLayer )
+    throw QgisHeadlessError( errorMessage );
+
+  if ( QgsFeatureRenderer *renderer = qgsVectorLayer->renderer() )
+  {
+    QgsRenderContext renderContext;
+    for ( QgsSymbol *symbol : renderer->symbols( renderContext ) )
+      preloadSymbol( symbol, dpi, sizes );
+  }
+
+  if ( const QgsAbstractVectorLayerLabeling *labeling = qgsVectorLayer->labeling() )
+    preloadLabelingBackground( labeling, dpi );
+}
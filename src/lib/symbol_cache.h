@@ -0,0 +1,48 @@
+/******************************************************************************
+*  Project: NextGIS GIS libraries
+*  Purpose: NextGIS headless renderer
+*  Author:  Denis Ilyin, denis.ilyin@nextgis.com
+*******************************************************************************
+*  Copyright (C) 2026 NextGIS, info@nextgis.ru
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef QGIS_HEADLESS_SYMBOL_CACHE_H
+#define QGIS_HEADLESS_SYMBOL_CACHE_H
+
+#include <vector>
+#include "style.h"
+
+namespace HeadlessRender
+{
+  /**
+   * Fills QGIS process-wide caches of rasterized SVG and raster image symbols ahead of rendering.
+   */
+  class QGIS_HEADLESS_EXPORT SymbolCache
+  {
+    public:
+      /**
+       * Rasterizes all SVG and raster image symbols of style ahead of rendering.
+       * \param style style, symbols of which are rasterized.
+       * \param dpi resolution, at which symbols will be rendered on map.
+       * \param sizes sizes of legend icons in pixels, at which symbols are also rasterized.
+       */
+      static void preload( const Style &style, int dpi, const std::vector<int> &sizes = {} );
+
+    private:
+      SymbolCache() = delete;
+  };
+} //namespace HeadlessRender
+
+#endif // QGIS_HEADLESS_SYMBOL_CACHE_H
@@ -22,9 +22,11 @@
 #define QGIS_HEADLESS_TYPES_H
 
 #include <array>
+#include <cstddef>
 #include <string>
 #include <set>
 #include <memory>
+#include <tuple>
 
 class QgsMapLayer;
 
@@ -94,6 +96,26 @@ namespace HeadlessRender
   typedef std::shared_ptr<QgsMapLayer> QgsMapLayerPtr;
 
   typedef long StyleCategory;
+
+  typedef size_t LayerIndex;
+
+  typedef std::tuple<double, double, double, double> Extent;
+
+  typedef std::tuple<int, int, int, int, int> TileRange; // zoom, xmin, ymin, xmax, ymax
+
+  /**
+   * Statistics of a process-wide cache.
+   */
+  struct CacheStats
+  {
+      std::size_t hits = 0;
+      std::size_t misses = 0;
+      std::size_t evictions = 0;
+      std::size_t invalidations = 0;
+      std::size_t size = 0;     // number of entries
+      std::size_t cost = 0;     // total cost of entries, e.g. bytes
+      std::size_t capacity = 0; // maximum total cost of entries
+  };
 } //namespace HeadlessRender
 
 #endif // QGIS_HEADLESS_TYPES_H
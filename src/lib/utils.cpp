@@ -20,6 +20,8 @@
 
 #include "utils.h"
 #include <qgsrasterlayer.h>
+#include <QDateTime>
+#include <QFileInfo>
 
 Qgis::WkbType HeadlessRender::layerGeometryTypeToQgsWkbType( HeadlessRender::LayerGeometryType geometryType )
 {
@@ -81,6 +83,29 @@ QVariant::Type HeadlessRender::layerAttributeTypetoQVariantType(
   return QVariant::Int;
 }
 
+HeadlessRender::LayerAttributeType HeadlessRender::qVariantTypeToLayerAttributeType( QVariant::Type type )
+{
+  switch ( type )
+  {
+    case QVariant::Int:
+      return HeadlessRender::LayerAttributeType::Integer;
+    case QVariant::Double:
+      return HeadlessRender::LayerAttributeType::Real;
+    case QVariant::Date:
+      return HeadlessRender::LayerAttributeType::Date;
+    case QVariant::Time:
+      return HeadlessRender::LayerAttributeType::Time;
+    case QVariant::DateTime:
+      return HeadlessRender::LayerAttributeType::DateTime;
+    case QVariant::LongLong:
+      return HeadlessRender::LayerAttributeType::Integer64;
+    case QVariant::Bool:
+      return HeadlessRender::LayerAttributeType::Boolean;
+    default:
+      return HeadlessRender::LayerAttributeType::String;
+  }
+}
+
 HeadlessRender::QgsMapLayerPtr HeadlessRender::createTemporaryVectorLayer(
   const QgsVectorLayer::LayerOptions &layerOptions
 )
@@ -108,3 +133,17 @@ HeadlessRender::QgsMapLayerPtr HeadlessRender::createTemporaryLayerByType(
   else
     return createTemporaryVectorLayer( layerOptions );
 }
+
+HeadlessRender::SourceState HeadlessRender::sourceState( const QString &uri )
+{
+  // Inline documents (e.g. GeoJSON), passed as URI too, are not existing files
+  const QFileInfo fileInfo( uri.section( '|', 0, 0 ) );
+  SourceState state;
+  if ( fileInfo.isFile() )
+  {
+    state.file = true;
+    state.mtime = fileInfo.lastModified().toMSecsSinceEpoch();
+    state.size = fileInfo.size();
+  }
+  return state;
+}
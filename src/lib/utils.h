@@ -30,12 +30,29 @@ namespace HeadlessRender
 {
   Qgis::WkbType layerGeometryTypeToQgsWkbType( HeadlessRender::LayerGeometryType geometryType );
   QVariant::Type layerAttributeTypetoQVariantType( HeadlessRender::LayerAttributeType attributeType );
+  HeadlessRender::LayerAttributeType qVariantTypeToLayerAttributeType( QVariant::Type type );
 
   QgsMapLayerPtr createTemporaryVectorLayer( const QgsVectorLayer::LayerOptions &layerOptions );
   QgsMapLayerPtr createTemporaryRasterLayer();
   QgsMapLayerPtr createTemporaryLayerByType(
     HeadlessRender::DataType type, const QgsVectorLayer::LayerOptions &layerOptions
   );
+
+  // State of the source file, by which cached data of the source is revalidated
+  struct SourceState
+  {
+      bool file = false; // false for inline documents, databases, URLs etc., never revalidated
+      qint64 mtime = -1;
+      qint64 size = -1;
+
+      bool operator==( const SourceState &other ) const
+      {
+        return file == other.file && mtime == other.mtime && size == other.size;
+      }
+  };
+
+  // Returns state of the file, which URI of a data source refers to, URI options are ignored
+  SourceState sourceState( const QString &uri );
 } //namespace HeadlessRender
 
 #endif // QGIS_HEADLESS_UTILS_H